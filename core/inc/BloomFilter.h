@@ -0,0 +1,44 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <cstdint>
+
+namespace ObjectSerializer
+{
+    // Compact set of object IDs which answers "certainly not contained" without
+    // looking into the data file. Contained IDs are always reported, other IDs
+    // are reported with the false positive rate the filter was sized for.
+    // A filter without bits reports every ID as possibly contained.
+    class OBJECT_SERIALIZER_API BloomFilter
+    {
+        public:
+        BloomFilter();
+        BloomFilter(std::size_t expectedCount, double falsePositiveRate = 0.01);
+
+        // Clears the filter and sizes it for expectedCount IDs
+        void reset(std::size_t expectedCount, double falsePositiveRate = 0.01);
+        void clear();
+
+        void insert(std::size_t objectID);
+        bool mightContain(std::size_t objectID) const;
+
+        // Inserts the IDs of all objects in the data file
+        bool build(const std::string& dataFilename, const Serializer::Settings& settings = Serializer::Settings(), double falsePositiveRate = 0.01);
+
+        // The filter file stores the size and modification time of the data file, and with
+        // hashContent a hash of its content. loadFromFile() fails if the data file changed
+        // since, because IDs may be missing then. Without the hash, changes which keep the size
+        // within the resolution of the file time go unnoticed, but neither function reads the
+        // whole data file. The filter is replaced in one step.
+        bool saveToFile(const std::string& filterFilename, const std::string& dataFilename, bool hashContent = true) const;
+        bool loadFromFile(const std::string& filterFilename, const std::string& dataFilename);
+
+        std::size_t getBitCount() const { return m_bits.size() * 64; }
+        std::size_t getHashCount() const { return m_hashCount; }
+
+        private:
+        std::vector<std::uint64_t> m_bits;
+        std::size_t m_hashCount;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+#include "IDAllocator.h"
+
+#include <cstdint>
+#include <algorithm>
+
+namespace ObjectSerializer
+{
+    // Stores objects as one column per registered member (structure of arrays).
+    // A single member of all objects of a type can be loaded without reading the
+    // other members. Only types with members registered by
+    // Serializer::registerMembers<T>() can be stored.
+    // The order of the objects is kept per type, not across types.
+    class OBJECT_SERIALIZER_API ColumnStore
+    {
+        public:
+        ColumnStore() = delete;
+
+        static bool saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs);
+        static bool saveTo(IDataSink& sink, const std::vector<ISerializable*>& objs);
+
+        // Number of stored objects of type T
+        template <typename T>
+        static bool getObjectCount(const std::string& filename, std::size_t& count)
+        {
+            return getRowCount(filename, typeid(T).hash_code(), count);
+        }
+
+        // Loads one member of all stored objects of type T into a contiguous array.
+        // Usage: loadColumn(filename, &ExampleStruct::b, values);
+        template <typename T, typename M>
+        static bool loadColumn(const std::string& filename, M T::* member, std::vector<M>& column)
+        {
+            static_assert(std::is_trivially_copyable<M>::value, "Members must be trivially copyable");
+            ColumnInfo info;
+            if (!findColumn(filename, typeid(T).hash_code(), Serializer::getMemberOffset<T>(member), sizeof(M), info))
+                return false;
+            column.resize(info.rowCount);
+            return readColumn(filename, info, 0, info.rowCount, reinterpret_cast<char*>(column.data()));
+        }
+
+        // Reconstructs up to count objects of type T, beginning with the object at index first.
+        template <typename T>
+        static bool loadObjects(const std::string& filename, std::vector<T>& objs, std::size_t first = 0, std::size_t count = SIZE_MAX)
+        {
+            std::size_t rowCount = 0;
+            if (!getRowCount(filename, typeid(T).hash_code(), rowCount))
+                return false;
+            if (first > rowCount)
+                first = rowCount;
+            count = std::min(count, rowCount - first);
+
+            objs.resize(count);
+            std::vector<char*> targets(count);
+            for (std::size_t i = 0; i < count; ++i)
+                targets[i] = reinterpret_cast<char*>(&objs[i]);
+            if (!readRows(filename, typeid(T).hash_code(), first, targets))
+                return false;
+            // Objects created later must not get the IDs of the loaded ones
+            if constexpr (std::is_base_of<ISerializableID, T>::value)
+            {
+                std::size_t nextFreeID = 0;
+                for (const T& obj : objs)
+                    nextFreeID = std::max(nextFreeID, obj.getID() + 1);
+                IDAllocator::seed(nextFreeID);
+            }
+            return true;
+        }
+
+        private:
+        struct ColumnInfo
+        {
+            std::size_t rowCount;
+            std::size_t size;
+            std::uint64_t dataOffset;
+        };
+
+        static bool getRowCount(const std::string& filename, std::size_t typeHash, std::size_t& count);
+        static bool findColumn(const std::string& filename, std::size_t typeHash, std::size_t memberOffset, std::size_t memberSize, ColumnInfo& info);
+        static bool readColumn(const std::string& filename, const ColumnInfo& info, std::size_t first, std::size_t count, char* destination);
+        static bool readRows(const std::string& filename, std::size_t typeHash, std::size_t first, const std::vector<char*>& objects);
+    };
+}
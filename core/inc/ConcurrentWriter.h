@@ -0,0 +1,83 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ObjectSerializer
+{
+    // Appends objects from many threads to a data file.
+    // addObject() encodes the object on the calling thread into a pooled node and
+    // pushes it onto a lock free queue. A background thread takes all queued records at once
+    // and appends them to the file with one write.
+    // Records of one thread keep their order, records of different threads interleave.
+    class OBJECT_SERIALIZER_API ConcurrentWriter
+    {
+        public:
+        ConcurrentWriter(const std::string& filename);
+        ConcurrentWriter(const std::string& filename, const Serializer::Settings& settings);
+        ~ConcurrentWriter();
+        ConcurrentWriter(const ConcurrentWriter&) = delete;
+        ConcurrentWriter& operator=(const ConcurrentWriter&) = delete;
+
+        // Opens the file for appending and starts the writer thread.
+        // Not possible for sorted files, see Serializer::Settings::sparseIndexInterval.
+        bool open();
+        // Writes all queued records and stops the writer thread.
+        // Returns false if a write failed since open().
+        // Calls which run concurrently either finish before the records get written or fail.
+        bool close();
+        bool isOpen() const { return m_open.load(std::memory_order_acquire); }
+
+        // Thread safe, the object can be changed or deleted once the call returns
+        bool addObject(const ISerializable* obj);
+        // Thread safe, record holds records encoded with the settings of the writer
+        bool addRecord(std::vector<char>&& record);
+
+        // Returns once all records added before the call are written to the file,
+        // and synced to the disk unless the sync policy is None
+        bool flush();
+
+        const std::string& getFilename() const { return m_filename; }
+
+        private:
+        struct Node
+        {
+            Node* next = nullptr;
+            std::vector<char> record;
+            // Flush and close requests, the writer answers them in queue order
+            std::promise<bool>* done = nullptr;
+            bool stop = false;
+        };
+        // Producers enter before they push, close() waits until all of them left
+        bool enter();
+        void leave();
+        Node* acquireNode();
+        void releaseNodes(const std::vector<Node*>& nodes);
+        void push(Node* node);
+        bool request(bool stop);
+        // Appends the records under the file mutex of the Serializer
+        bool writeBatch(const std::vector<char>& batch);
+        void writeLoop();
+
+        static constexpr std::size_t s_maxFreeNodes = 1024;
+        static constexpr std::size_t s_maxPooledRecordSize = 64 * 1024;
+
+        std::string m_filename;
+        Serializer::Settings m_settings;
+        std::unique_ptr<SyncFileSink> m_sink;
+        // Most recently pushed node, the queue is consumed as a whole
+        std::atomic<Node*> m_head;
+        std::thread m_thread;
+        std::atomic<bool> m_open;
+        std::atomic<std::size_t> m_producers;
+        // Written nodes, reused by the next records
+        std::mutex m_poolMutex;
+        std::vector<Node*> m_freeNodes;
+        bool m_failed;
+    };
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+
+#include <vector>
+#include <span>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ObjectSerializer
+{
+    // Destination for serialized bytes.
+    // Implement this interface to let the Serializer write into your own I/O layer.
+    class OBJECT_SERIALIZER_API IDataSink
+    {
+        public:
+        virtual ~IDataSink() = default;
+
+        // Appends size bytes. Returns false if the bytes could not be written.
+        virtual bool write(const char* data, std::size_t size) = 0;
+    };
+
+    // Appends to a std::vector<char>.
+    class OBJECT_SERIALIZER_API BufferSink : public IDataSink
+    {
+        public:
+        BufferSink(std::vector<char>& buffer);
+
+        bool write(const char* data, std::size_t size) override;
+
+        std::vector<char>& getBuffer() const { return m_buffer; }
+        private:
+        std::vector<char>& m_buffer;
+    };
+
+    // Writes into a fixed size memory region.
+    // Writes which do not fit into the remaining space fail without writing anything.
+    class OBJECT_SERIALIZER_API SpanSink : public IDataSink
+    {
+        public:
+        SpanSink(std::span<char> buffer);
+
+        bool write(const char* data, std::size_t size) override;
+
+        // Number of bytes written so far
+        std::size_t getPosition() const { return m_position; }
+        private:
+        std::span<char> m_buffer;
+        std::size_t m_position;
+    };
+
+    // Writes to an already opened std::ostream.
+    class OBJECT_SERIALIZER_API StreamSink : public IDataSink
+    {
+        public:
+        StreamSink(std::ostream& stream);
+
+        bool write(const char* data, std::size_t size) override;
+        private:
+        std::ostream& m_stream;
+    };
+
+    class OBJECT_SERIALIZER_API FileSink : public IDataSink
+    {
+        public:
+        FileSink(const std::string& filename);
+
+        bool write(const char* data, std::size_t size) override;
+
+        bool isOpen() const { return m_file.is_open(); }
+        void close() { m_file.close(); }
+        private:
+        std::ofstream m_file;
+    };
+
+    // Writes to a file through the OS file API so that the written bytes can be
+    // forced to the disk with sync(). Used where data must survive a crash.
+    class OBJECT_SERIALIZER_API SyncFileSink : public IDataSink
+    {
+        public:
+        enum class Mode
+        {
+            Truncate, // Creates the file or clears an existing one
+            Append,   // Creates the file or writes behind the existing content
+            Update    // Opens an existing file at position 0 without changing it
+        };
+
+        SyncFileSink(const std::string& filename, Mode mode = Mode::Truncate);
+        ~SyncFileSink();
+        SyncFileSink(const SyncFileSink&) = delete;
+        SyncFileSink& operator=(const SyncFileSink&) = delete;
+
+        bool write(const char* data, std::size_t size) override;
+
+        // Moves the write position to offset bytes from the start of the file
+        bool seek(std::uint64_t offset);
+        // Returns after all written bytes are stored on the disk
+        bool sync();
+        // Makes created, renamed or deleted entries of a directory durable.
+        // Not needed on Windows, where it does nothing.
+        static bool syncDirectory(const std::string& path);
+
+        bool isOpen() const;
+        void close();
+        private:
+#ifdef _WIN32
+        void* m_handle;
+#else
+        int m_fd;
+#endif
+    };
+
+    // Collects writes in a buffer and hands full buffers to a background thread,
+    // which writes them to the target while the next buffer gets filled.
+    // The thread only starts once the first buffer is full.
+    // Call flush() before using the target otherwise, the destructor flushes too.
+    class OBJECT_SERIALIZER_API BackgroundSink : public IDataSink
+    {
+        public:
+        BackgroundSink(IDataSink& target, std::size_t bufferSize = 1024 * 1024);
+        ~BackgroundSink();
+        BackgroundSink(const BackgroundSink&) = delete;
+        BackgroundSink& operator=(const BackgroundSink&) = delete;
+
+        bool write(const char* data, std::size_t size) override;
+
+        // Writes all buffered bytes to the target.
+        // Returns false if any write to the target failed.
+        bool flush();
+        private:
+        bool submit();
+        void writeLoop();
+
+        IDataSink& m_target;
+        std::size_t m_bufferSize;
+        std::vector<char> m_buffer;
+        std::vector<char> m_writing;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_signal;
+        bool m_hasWork;
+        bool m_stop;
+        bool m_failed;
+    };
+}
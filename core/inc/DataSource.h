@@ -0,0 +1,113 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+
+#include <vector>
+#include <span>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ObjectSerializer
+{
+    // Origin of serialized bytes.
+    // Implement this interface to let the Serializer read from your own I/O layer.
+    class OBJECT_SERIALIZER_API IDataSource
+    {
+        public:
+        virtual ~IDataSource() = default;
+
+        // Reads exactly size bytes. Returns false if not enough bytes are available.
+        virtual bool read(char* data, std::size_t size) = 0;
+
+        // Skips up to size bytes. Returns false if the end was reached before.
+        virtual bool skip(std::size_t size) = 0;
+    };
+
+    // Reads from a contiguous memory region which must outlive the source.
+    class OBJECT_SERIALIZER_API BufferSource : public IDataSource
+    {
+        public:
+        BufferSource(std::span<const char> buffer);
+        BufferSource(const std::vector<char>& buffer);
+
+        bool read(char* data, std::size_t size) override;
+        bool skip(std::size_t size) override;
+
+        std::size_t getPosition() const { return m_position; }
+        std::size_t getRemaining() const { return m_buffer.size() - m_position; }
+        private:
+        std::span<const char> m_buffer;
+        std::size_t m_position;
+    };
+
+    // Reads from an already opened std::istream.
+    class OBJECT_SERIALIZER_API StreamSource : public IDataSource
+    {
+        public:
+        StreamSource(std::istream& stream);
+
+        bool read(char* data, std::size_t size) override;
+        bool skip(std::size_t size) override;
+        private:
+        std::istream& m_stream;
+    };
+
+    class OBJECT_SERIALIZER_API FileSource : public IDataSource
+    {
+        public:
+        FileSource(const std::string& filename);
+
+        bool read(char* data, std::size_t size) override;
+        bool skip(std::size_t size) override;
+
+        bool isOpen() const { return m_file.is_open(); }
+        void close() { m_file.close(); }
+        private:
+        std::ifstream m_file;
+    };
+
+    // Reads a file on a background thread into a ring of depth buffers, while
+    // the caller decodes the bytes of the buffers which are already filled.
+    // The thread starts in the constructor and stays up to depth buffers ahead.
+    class OBJECT_SERIALIZER_API ReadAheadSource : public IDataSource
+    {
+        public:
+        ReadAheadSource(const std::string& filename, std::size_t bufferSize = 1024 * 1024, std::size_t depth = 4);
+        ~ReadAheadSource();
+        ReadAheadSource(const ReadAheadSource&) = delete;
+        ReadAheadSource& operator=(const ReadAheadSource&) = delete;
+
+        bool read(char* data, std::size_t size) override;
+        bool skip(std::size_t size) override;
+
+        bool isOpen() const { return m_open; }
+        private:
+        struct Buffer
+        {
+            std::vector<char> data;
+            std::size_t size = 0;
+        };
+        // Makes the next filled buffer the current one.
+        // Returns false at the end of the file.
+        bool nextBuffer();
+        void readLoop();
+
+        std::ifstream m_file;
+        std::vector<Buffer> m_buffers;
+        // Consumer side, only used by the caller
+        std::size_t m_current;
+        std::size_t m_position;
+        bool m_hasCurrent;
+        // Filled buffers which were not handed back yet, including the current one.
+        // The reader fills the buffers behind them.
+        std::size_t m_filled;
+        bool m_end;
+        bool m_stop;
+        bool m_open;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_signal;
+    };
+}
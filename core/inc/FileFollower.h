@@ -0,0 +1,53 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <chrono>
+
+namespace ObjectSerializer
+{
+    // Follows a data file while another process appends records to it.
+    // Each poll() loads only the records written since the previous one. A record
+    // whose bytes are not all written yet is left for a later poll.
+    // If the file shrinks or gets replaced by another file, because it was compacted or
+    // saved again, following starts again at its beginning and the objects of the file
+    // are loaded once more.
+    class OBJECT_SERIALIZER_API FileFollower
+    {
+        public:
+        FileFollower(const std::string& filename);
+        FileFollower(const std::string& filename, const Serializer::Settings& settings);
+
+        // Appends the objects of the new complete records to objs.
+        // Returns false if the file can't be read or holds a record of unknown size.
+        bool poll(std::vector<ISerializable*>& objs);
+        // Returns true once the file changed since the last poll, false after the timeout
+        bool waitForChange(std::chrono::milliseconds timeout, std::chrono::milliseconds interval = std::chrono::milliseconds(10)) const;
+
+        // Starts following at the beginning of the file again
+        void reset();
+        // End of the last complete record read
+        std::uint64_t getOffset() const { return m_offset; }
+        const std::string& getFilename() const { return m_filename; }
+
+        private:
+        bool fileChanged() const;
+        // Device and inode on POSIX, volume serial number and file index on Windows
+        static bool getFileIdentity(const std::string& filename, std::uint64_t& device, std::uint64_t& index);
+        // Decodes the complete records at the start of m_buffer, consumed is the number of their bytes
+        bool readRecords(std::size_t size, std::vector<ISerializable*>& objs, std::size_t& consumed, std::size_t& nextFreeID) const;
+
+        static constexpr std::size_t s_readChunkSize = 1024 * 1024;
+
+        std::string m_filename;
+        Serializer::Settings m_settings;
+        std::uint64_t m_offset;
+        // File state at the last poll, waitForChange() compares against it
+        std::uint64_t m_fileSize;
+        std::int64_t m_fileTime;
+        // Identity of the followed file, a file replaced with a rename gets a new one
+        std::uint64_t m_fileDevice;
+        std::uint64_t m_fileIndex;
+        std::vector<char> m_buffer;
+    };
+}
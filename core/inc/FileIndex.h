@@ -0,0 +1,62 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <cstdint>
+
+namespace ObjectSerializer
+{
+    // Maps object IDs to the position of their record in a file and keeps
+    // the positions of the records of each type in file order.
+    // Build it once with build() to look up objects without scanning the file,
+    // and store it next to the data file with saveToFile() to reuse it later.
+    // The index must be rebuilt if records get added or moved.
+    // Pass it to Serializer::loadFromFile() to load several objects with few reads
+    // or to Serializer::loadAllOfType() to read only the records of one type.
+    class OBJECT_SERIALIZER_API FileIndex
+    {
+        public:
+        struct Entry
+        {
+            std::size_t typeHash;
+            std::uint64_t offset; // Position of the record header in the file
+        };
+
+        FileIndex();
+
+        // Scans the file and indexes all records.
+        // Only records of types derived from ISerializableID can be found by ID.
+        bool build(const std::string& filename, const Serializer::Settings& settings = Serializer::Settings());
+
+        bool saveToFile(const std::string& indexFilename) const;
+        bool loadFromFile(const std::string& indexFilename);
+
+        bool find(std::size_t objectID, Entry& entry) const;
+        void insert(std::size_t objectID, const Entry& entry);
+        // Removes the object and adds its record to the free slots of its type
+        bool remove(std::size_t objectID);
+        void clear();
+        std::size_t size() const { return m_entries.size(); }
+
+        // Positions of all records of a type, sorted by offset
+        std::span<const std::uint64_t> getOffsets(std::size_t typeHash) const;
+        template <typename T>
+        std::span<const std::uint64_t> getOffsets() const
+        {
+            return getOffsets(typeid(T).hash_code());
+        }
+
+        // Positions of deleted records of a type, which can be reused for new records
+        std::span<const std::uint64_t> getFreeOffsets(std::size_t typeHash) const;
+        bool takeFreeOffset(std::size_t typeHash, std::uint64_t& offset);
+
+        const std::unordered_map<std::size_t, Entry>& getEntries() const { return m_entries; }
+        private:
+        void addOffset(std::size_t typeHash, std::uint64_t offset);
+        void removeOffset(std::size_t typeHash, std::uint64_t offset);
+
+        std::unordered_map<std::size_t, Entry> m_entries;
+        std::unordered_map<std::size_t, std::vector<std::uint64_t>> m_typeOffsets;
+        std::unordered_map<std::size_t, std::vector<std::uint64_t>> m_freeOffsets;
+    };
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace ObjectSerializer
+{
+    // Thread safe source of unique object IDs.
+    // Each thread reserves a block of IDs from a shared atomic counter and
+    // serves further allocations from that block without synchronization.
+    // IDs are unique for the process but not contiguous across threads.
+    class OBJECT_SERIALIZER_API IDAllocator
+    {
+        public:
+        IDAllocator() = delete;
+
+        static std::size_t allocate();
+
+        // Makes sure that all IDs allocated after this call are >= minNextID.
+        // Blocks reserved by other threads which start below minNextID get discarded.
+        // Allocations which run concurrently to this call are not ordered against it.
+        static void seed(std::size_t minNextID);
+
+        // Returns the lowest ID which has not been reserved by any thread yet.
+        static std::size_t getNextFreeID();
+
+        static void setBlockSize(std::size_t size);
+        static std::size_t getBlockSize();
+
+        private:
+        static std::atomic<std::size_t> s_nextID;
+        // Highest ID passed to seed(), blocks starting below it are not used anymore
+        static std::atomic<std::size_t> s_minID;
+        static std::atomic<std::size_t> s_blockSize;
+    };
+}
@@ -20,6 +20,7 @@ namespace ObjectSerializer
 		}
 
         private:
+        friend class Serializer;
         std::size_t m_id;
 
         static std::size_t getNextID();
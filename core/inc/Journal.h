@@ -0,0 +1,82 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ObjectSerializer
+{
+    // Write-ahead journal for updates of objects in an ID based data file.
+    // overrideInFile() appends the new object to "<dataFile>.wal" and returns once
+    // it is on the disk. Concurrent updates get written and synced together (group commit).
+    // The data file only gets changed by checkpoint(), which applies the latest
+    // version of each updated object. Updates found in the journal by open() are
+    // applied after a crash. All functions are thread safe.
+    class OBJECT_SERIALIZER_API Journal
+    {
+        public:
+        struct Settings
+        {
+            // Time the commit thread waits for more updates before it syncs a batch
+            std::chrono::microseconds commitDelay = std::chrono::microseconds(2000);
+            // Batches of this size get synced without waiting for commitDelay
+            std::size_t commitBytes = 256 * 1024;
+            // Journal size after which an update triggers a checkpoint, 0 to disable
+            std::size_t checkpointBytes = 16 * 1024 * 1024;
+        };
+
+        Journal(const std::string& dataFilename);
+        Journal(const std::string& dataFilename, const Serializer::Settings& settings, const Settings& journalSettings);
+        ~Journal();
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        // Applies updates left in the journal and starts the commit thread
+        bool open();
+        // Applies all updates to the data file and stops the commit thread
+        bool close();
+        bool isOpen() const;
+
+        // Returns after the update is durable in the journal
+        bool overrideInFile(const ISerializableID* obj);
+        // Loads the latest version of an object, including updates not applied to the data file yet
+        bool loadFromFile(std::size_t objectID, ISerializableID*& obj) const;
+
+        // Writes all journaled updates into the data file, syncs it and clears the journal
+        bool checkpoint();
+
+        // Number of updated objects which are not applied to the data file yet
+        std::size_t getPendingCount() const;
+        const std::string& getJournalFilename() const { return m_journalFilename; }
+
+        private:
+        void commitLoop();
+        bool applyPending(const std::unordered_map<std::size_t, std::vector<char>>& pending);
+        bool recover();
+
+        std::string m_dataFilename;
+        std::string m_journalFilename;
+        Serializer::Settings m_settings;
+        Settings m_journalSettings;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_commitSignal;
+        std::condition_variable m_durableSignal;
+        std::thread m_commitThread;
+        std::unique_ptr<SyncFileSink> m_journal;
+        // Encoded journal entries which are not written yet
+        std::vector<char> m_batch;
+        std::uint64_t m_enqueued;
+        std::uint64_t m_durable;
+        std::uint64_t m_journalSize;
+        bool m_running;
+        bool m_failed;
+        bool m_checkpointing;
+        // Latest encoded record of each updated object
+        std::unordered_map<std::size_t, std::vector<char>> m_pending;
+    };
+}
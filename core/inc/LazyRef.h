@@ -0,0 +1,143 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+#include "FileIndex.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace ObjectSerializer
+{
+    // File from which LazyRef objects get loaded, shared by all references into it.
+    // open() indexes the file once, afterwards each load reads only the requested records.
+    // Without open() every load scans the file. The file must not change while it is open.
+    class OBJECT_SERIALIZER_API LazyFile
+    {
+        public:
+        LazyFile(const std::string& filename);
+        LazyFile(const std::string& filename, const Serializer::Settings& settings);
+
+        bool open();
+        bool isOpen() const { return m_indexed; }
+
+        bool load(std::size_t objectID, ISerializableID*& obj) const;
+        // objs[i] is the object with objectIDs[i] or nullptr if it is not in the file
+        bool load(std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const;
+
+        const std::string& getFilename() const { return m_filename; }
+        private:
+        std::string m_filename;
+        Serializer::Settings m_settings;
+        FileIndex m_index;
+        bool m_indexed;
+    };
+
+    // Reference to an object of type T in a file, which gets loaded on first access.
+    // The loaded object is kept by the reference and shared with its copies made afterwards.
+    // Use prefetch() to load the objects of many references with one pass over the file.
+    // A reference must not be resolved by several threads at the same time.
+    template <typename T>
+    class LazyRef
+    {
+        static_assert(std::is_base_of<ISerializableID, T>::value, "T must be derived from ISerializableID");
+        public:
+        LazyRef()
+            : m_objectID(0)
+            , m_resolved(false)
+        {}
+        LazyRef(std::shared_ptr<const LazyFile> file, std::size_t objectID)
+            : m_file(std::move(file))
+            , m_objectID(objectID)
+            , m_resolved(false)
+        {}
+
+        std::size_t getID() const { return m_objectID; }
+        const std::shared_ptr<const LazyFile>& getFile() const { return m_file; }
+        bool isLoaded() const { return m_resolved; }
+
+        // Loads the object on the first call.
+        // Returns nullptr if the file holds no object of type T with the ID.
+        T* get() const
+        {
+            if (!m_resolved)
+            {
+                ISerializableID* obj = nullptr;
+                if (m_file)
+                    m_file->load(m_objectID, obj);
+                setObject(obj);
+            }
+            return m_object.get();
+        }
+        T* operator->() const { return get(); }
+        T& operator*() const { return *get(); }
+
+        // Drops the loaded object, the next access loads it again
+        void reset()
+        {
+            m_object.reset();
+            m_resolved = false;
+        }
+
+        // Loads the objects of all references which are not loaded yet.
+        // References to the same object share one loaded instance.
+        static bool prefetch(std::span<LazyRef<T>> refs)
+        {
+            bool success = true;
+            std::vector<LazyRef<T>*> pending;
+            for (LazyRef<T>& ref : refs)
+            {
+                if (!ref.m_resolved)
+                    pending.push_back(&ref);
+            }
+            // One multi-get per file, each ID once
+            std::sort(pending.begin(), pending.end(), [](const LazyRef<T>* a, const LazyRef<T>* b)
+                {
+                    return a->m_file != b->m_file ? a->m_file < b->m_file : a->m_objectID < b->m_objectID;
+                });
+            std::size_t begin = 0;
+            while (begin < pending.size())
+            {
+                std::size_t end = begin;
+                std::vector<std::size_t> ids;
+                while (end < pending.size() && pending[end]->m_file == pending[begin]->m_file)
+                {
+                    if (ids.empty() || ids.back() != pending[end]->m_objectID)
+                        ids.push_back(pending[end]->m_objectID);
+                    ++end;
+                }
+                std::vector<ISerializableID*> objs(ids.size(), nullptr);
+                if (pending[begin]->m_file)
+                    success = pending[begin]->m_file->load(ids, objs) && success;
+
+                std::size_t idIndex = 0;
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    if (i > begin && pending[i]->m_objectID == pending[i - 1]->m_objectID)
+                    {
+                        pending[i]->m_object = pending[i - 1]->m_object;
+                        pending[i]->m_resolved = true;
+                        continue;
+                    }
+                    pending[i]->setObject(objs[idIndex++]);
+                }
+                begin = end;
+            }
+            return success;
+        }
+
+        private:
+        void setObject(ISerializableID* obj) const
+        {
+            T* object = dynamic_cast<T*>(obj);
+            if (!object)
+                delete obj;
+            m_object.reset(object);
+            m_resolved = true;
+        }
+
+        std::shared_ptr<const LazyFile> m_file;
+        std::size_t m_objectID;
+        mutable std::shared_ptr<T> m_object;
+        mutable bool m_resolved;
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace ObjectSerializer
+{
+    // LRU cache for objects loaded by ID from files.
+    // Cached objects are shared as immutable, reference counted objects.
+    // Objects which are still referenced outside of the cache stay valid after
+    // they got evicted. Changes to the files which are not made through
+    // overrideInFile() of this cache must be followed by invalidate().
+    // All functions are thread safe.
+    class OBJECT_SERIALIZER_API ObjectCache
+    {
+        public:
+        // memoryBudget is the maximum sum of the object sizes held by the cache in bytes
+        ObjectCache(std::size_t memoryBudget);
+        ObjectCache(std::size_t memoryBudget, const Serializer::Settings& settings);
+        ~ObjectCache();
+
+        // Returns the cached object or loads it from the file.
+        // Returns nullptr if the object does not exist.
+        std::shared_ptr<const ISerializableID> get(const std::string& filename, std::size_t objectID);
+
+        // Writes obj to the file and drops the cached version of it
+        bool overrideInFile(const std::string& filename, const ISerializableID* obj);
+
+        void invalidate(const std::string& filename, std::size_t objectID);
+        void invalidate(const std::string& filename);
+        void clear();
+
+        void setMemoryBudget(std::size_t memoryBudget);
+        std::size_t getMemoryBudget() const;
+        std::size_t getMemoryUsage() const;
+        std::size_t getHitCount() const;
+        std::size_t getMissCount() const;
+
+        private:
+        struct Key
+        {
+            std::string filename;
+            std::size_t objectID;
+
+            bool operator==(const Key& other) const
+            {
+                return objectID == other.objectID && filename == other.filename;
+            }
+        };
+        struct KeyHash
+        {
+            std::size_t operator()(const Key& key) const
+            {
+                std::size_t hash = std::hash<std::string>()(key.filename);
+                return hash ^ (std::hash<std::size_t>()(key.objectID) + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+            }
+        };
+        struct Entry
+        {
+            Key key;
+            std::shared_ptr<const ISerializableID> object;
+            std::size_t size;
+        };
+        using EntryList = std::list<Entry>;
+
+        void insert(const Key& key, const std::shared_ptr<const ISerializableID>& object);
+        // Counts the changes of the file made through overrideInFile() or announced by invalidate()
+        std::size_t getGeneration(const std::string& filename) const;
+        void bumpGeneration(const std::string& filename);
+        void erase(EntryList::iterator it);
+        void evict();
+
+        Serializer::Settings m_settings;
+        mutable std::mutex m_mutex;
+        // Most recently used entry first
+        EntryList m_entries;
+        std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+        // A load whose file changed while it ran is not cached, it may hold the old object
+        std::unordered_map<std::string, std::size_t> m_generations;
+        std::size_t m_memoryBudget;
+        std::size_t m_memoryUsage;
+        std::size_t m_hits;
+        std::size_t m_misses;
+    };
+}
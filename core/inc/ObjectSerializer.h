@@ -15,5 +15,18 @@
 /// USER_SECTION_START 2
 #include "ISerializable.h"
 #include "ISerializableID.h"
+#include "IDAllocator.h"
+#include "DataSink.h"
+#include "DataSource.h"
 #include "Serializer.h"
+#include "ColumnStore.h"
+#include "ObjectCache.h"
+#include "FileIndex.h"
+#include "Journal.h"
+#include "ShardedStore.h"
+#include "BloomFilter.h"
+#include "LazyRef.h"
+#include "SharedMemory.h"
+#include "FileFollower.h"
+#include "ConcurrentWriter.h"
 /// USER_SECTION_END
\ No newline at end of file
@@ -1,18 +1,39 @@
 #pragma once
 #include "ObjectSerializer_base.h"
+#include "DataSink.h"
+#include "DataSource.h"
+#include "ISerializableID.h"
 
 #include <unordered_map>
 #include <vector>
 #include <functional>
 #include <typeindex>
 #include <fstream>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+#include <span>
+#include <cstdint>
+#include <future>
+#include <mutex>
 
 namespace ObjectSerializer
 {
     class ISerializable;
 	class ISerializableID;
+    class ColumnStore;
+    class FileIndex;
+    class BloomFilter;
+    class FileFollower;
+    class Journal;
     class OBJECT_SERIALIZER_API Serializer
     {
+        friend class ColumnStore;
+        friend class ConcurrentWriter;
+        friend class FileIndex;
+        friend class FileFollower;
+        friend class Journal;
+        public:
         struct VTableMetaData
         {
             enum Location
@@ -22,59 +43,205 @@ namespace ObjectSerializer
             };
             std::size_t size = sizeof(void**);
 			Location location = Location::Beginning;
+        };
+
+        // Per instance configuration.
+        // Files must be loaded with the same settings they were saved with.
+        enum class DuplicatePolicy
+        {
+            Copy, // Each duplicate is loaded as its own object
+            Share // Duplicates are the object of their original record. objs then holds
+                  // the same pointer several times, each object must be deleted once.
+        };
+        enum class SyncPolicy
+        {
+            None, // Leaves flushing to the OS
+            File, // Syncs the file before saveToFile() returns
+            Full  // Also syncs the directory, so that a new or renamed file survives a crash
+        };
+
+        struct Settings
+        {
+            // Writes the vtable pointer of the objects to the file
             bool serializeVtable = false;
+
+            // By default the vtable layout of each type is derived in registerType<T>().
+            // Set this to use vtable for all types instead.
+            bool customVtableLayout = false;
+            VTableMetaData vtable;
+
+            // Types with members registered by registerMembers<T>() are written
+            // member by member, without padding bytes and without the vtable.
+            bool packedEncoding = true;
+
+            // Stores the payload size in front of each record.
+            // Records of unknown or unwanted types can then be skipped without decoding them.
+            bool lengthFramedRecords = false;
+
+            // saveToFile() writes to a temporary "<file>.tmp.<process>.<count>" and renames it
+            // over the file when done.
+            // After a crash the file contains either the old or the new objects.
+            bool atomicSave = false;
+            SyncPolicy syncPolicy = SyncPolicy::None;
+
+            // When not 0, the objects get written sorted by their ID, objects without ID first.
+            // Behind the records follows a sparse index with the ID and position of every Nth object.
+            // Lookups by ID then binary search the index and read at most N records.
+            // addToFile() is not possible for such files, they must be saved again.
+            std::size_t sparseIndexInterval = 0;
+
+            // Objects without ID whose payload equals that of an object saved before
+            // in the same call are stored as a reference to that record.
+            // Only loadFrom() and loadFromFile() of all objects resolve the references,
+            // the other loaders skip them.
+            bool deduplicatePayloads = false;
+            DuplicatePolicy duplicatePolicy = DuplicatePolicy::Copy;
+        };
+
+        // Called with the type and the encoded payload of a record.
+        // Return true to load the record.
+        using RecordPredicate = std::function<bool(std::size_t typeHash, const char* payload, std::size_t size)>;
+
+        private:
+        static constexpr std::size_t s_noID = static_cast<std::size_t>(-1);
+        // Byte range of a registered member inside its object
+        struct FieldSpan
+        {
+            std::size_t offset;
+            std::size_t size;
+        };
+        // Pointer member to another serialized object
+        struct PointerMember
+        {
+            std::size_t offset;
+            std::function<const ISerializable*(const ISerializable*)> get;
+            std::function<void(ISerializable*, ISerializable*)> set;
         };
         struct ObjectMetaData
         {
             std::string name;
             std::size_t typeHash;
             std::size_t size;
+            VTableMetaData vtable;
 			std::function<ISerializable*()> create;
 
+            // Set by registerMembers<T>(). members holds each registered member,
+            // fields the same ranges sorted by offset with adjacent members merged.
+            std::vector<FieldSpan> members;
+            std::vector<FieldSpan> fields;
+            std::size_t packedSize = 0;
+
+            // Offset of the ID inside objects derived from ISerializableID
+            std::size_t idOffset = s_noID;
+
+            // Set by registerPointers<T>()
+            std::vector<PointerMember> pointers;
+
 			ObjectMetaData(const std::string& name, 
                            const std::size_t typeHash, 
                            const std::size_t size, 
+                           const VTableMetaData& vtable,
                            const std::function<ISerializable* ()>& create) 
                 : name(name)
                 , typeHash(typeHash)
                 , size(size)
+                , vtable(vtable)
                 , create(create)
             {}
             ObjectMetaData(const ObjectMetaData& other)
 				: name(other.name)
 				, typeHash(other.typeHash)
 				, size(other.size)
+				, vtable(other.vtable)
 				, create(other.create)
+				, members(other.members)
+				, fields(other.fields)
+				, packedSize(other.packedSize)
+				, idOffset(other.idOffset)
+				, pointers(other.pointers)
             {}
             ObjectMetaData(ObjectMetaData&& other) noexcept
                 : name(std::move(other.name))
                 , typeHash(std::move(other.typeHash))
                 , size(std::move(other.size))
+                , vtable(std::move(other.vtable))
                 , create(std::move(other.create))
+                , members(std::move(other.members))
+                , fields(std::move(other.fields))
+                , packedSize(other.packedSize)
+                , idOffset(other.idOffset)
+                , pointers(std::move(other.pointers))
             {}
 
         };
+
+        // Offsets are taken from uninitialized storage, constructing a T would use up an ID.
+        // The member must not be inherited from a virtual base of T.
+        template <typename T, typename MemberPointer>
+        static std::size_t getMemberOffset(MemberPointer member)
+        {
+            alignas(T) unsigned char storage[sizeof(T)];
+            const T* object = reinterpret_cast<const T*>(storage);
+            return static_cast<std::size_t>(reinterpret_cast<const char*>(&(object->*member)) - reinterpret_cast<const char*>(object));
+        }
+        template <typename T>
+        static std::size_t getIDOffset()
+        {
+            alignas(T) unsigned char storage[sizeof(T)];
+            const T* object = reinterpret_cast<const T*>(storage);
+            const std::size_t& id = static_cast<const ISerializableID*>(object)->m_id;
+            return static_cast<std::size_t>(reinterpret_cast<const char*>(&id) - reinterpret_cast<const char*>(object));
+        }
+
+        // Region of an object which gets written to the file.
+        // If fields is set, only these members are written back to back
+        // and size is the sum of their sizes.
+        struct PayloadLayout
+        {
+            std::size_t offset;
+            std::size_t size;
+            const std::vector<FieldSpan>* fields;
+            const std::vector<PointerMember>* pointers; // nullptr if the type has none
+        };
+        struct RecordHeader
+        {
+            std::size_t typeHash;
+            std::size_t payloadSize; // Only valid for length framed records
+        };
         public:
 #if LOGGER_LIBRARY_AVAILABLE == 1
         static Log::LogObject& getLogger();
 #endif
-        static VTableMetaData& getVTableMetaData();
-        static void saveVtable(bool doSave)
+
+        Serializer();
+        Serializer(const Settings& settings);
+        ~Serializer();
+
+        void setSettings(const Settings& settings)
+        {
+            m_settings = settings;
+        }
+        const Settings& getSettings() const
+        {
+            return m_settings;
+        }
+        // Settings of the static functions which are called without any
+        static const Settings& getDefaultSettings();
+        void saveVtable(bool doSave)
         {
-            getVTableMetaData().serializeVtable = doSave;
+            m_settings.serializeVtable = doSave;
         }
-		static void setVtableSize(std::size_t size)
+		void setVtableSize(std::size_t size)
 		{
-			getVTableMetaData().size = size;
+            m_settings.customVtableLayout = true;
+			m_settings.vtable.size = size;
 		}
-		static void setVtableLocation(VTableMetaData::Location location)
+		void setVtableLocation(VTableMetaData::Location location)
 		{
-			getVTableMetaData().location = location;
+            m_settings.customVtableLayout = true;
+			m_settings.vtable.location = location;
 		}
 
-        Serializer();
-        ~Serializer();
-
         template <typename T>
         static void registerType() {
 			size_t hashCode = typeid(T).hash_code();
@@ -86,13 +253,73 @@ namespace ObjectSerializer
                 return;
             }
 
+            VTableMetaData vtable;
+            vtable.size = std::is_polymorphic<T>::value ? sizeof(void*) : 0;
+            vtable.location = VTableMetaData::Location::Beginning;
+
 			ObjectMetaData meta(typeid(T).name(),
 								hashCode,
 								sizeof(T),
+                                vtable,
                                 []() { return new T(); });
+            if constexpr (std::is_base_of<ISerializableID, T>::value)
+                meta.idOffset = getIDOffset<T>();
 			getObjectMetaData().insert({ typeid(T).hash_code(), std::move(meta) });
         }
 
+        // Registers the members of T which get serialized when packedEncoding is enabled.
+        // The ID of types derived from ISerializableID is added automatically.
+        // Usage: registerMembers<ExampleStruct>(&ExampleStruct::text, &ExampleStruct::b);
+        template <typename T, typename... MemberPointers>
+        static void registerMembers(MemberPointers... members)
+        {
+            static_assert((std::is_member_object_pointer<MemberPointers>::value && ...), "Only data members can be registered");
+            if (!isTypeRegistered(typeid(T).hash_code()))
+                registerType<T>();
+
+            std::vector<FieldSpan> fields;
+            ([&]()
+                {
+                    using Member = std::remove_reference_t<decltype(std::declval<const T&>().*members)>;
+                    static_assert(std::is_trivially_copyable<Member>::value, "Members must be trivially copyable");
+                    fields.push_back({ getMemberOffset<T>(members), sizeof(Member) });
+                }(), ...);
+            if constexpr (std::is_base_of<ISerializableID, T>::value)
+                fields.push_back({ getIDOffset<T>(), sizeof(std::size_t) });
+            setMemberLayout(typeid(T).hash_code(), std::move(fields));
+        }
+
+        // Registers pointer members of T which point to other serialized objects.
+        // saveTo() stores them as the position of the target record in the saved
+        // block and loadFrom() points them to the loaded target in one pass after loading.
+        // Targets which are not saved in the same call become nullptr. So do the pointers
+        // of objects loaded by the other functions, which load objects without their targets.
+        // addToFile() stores them as nullptr, overrideInFile() and the Journal keep the
+        // pointers stored in the file, which stay valid as long as no record gets removed.
+        // With packedEncoding the pointers must be registered members too.
+        // Usage: registerPointers<Node>(&Node::parent, &Node::next);
+        template <typename T, typename... MemberPointers>
+        static void registerPointers(MemberPointers... members)
+        {
+            static_assert((std::is_member_object_pointer<MemberPointers>::value && ...), "Only data members can be registered");
+            if (!isTypeRegistered(typeid(T).hash_code()))
+                registerType<T>();
+
+            std::vector<PointerMember> pointers;
+            ([&]()
+                {
+                    using Pointer = std::remove_reference_t<decltype(std::declval<T&>().*members)>;
+                    using Target = std::remove_pointer_t<Pointer>;
+                    static_assert(std::is_pointer<Pointer>::value && std::is_base_of<ISerializable, std::remove_cv_t<Target>>::value,
+                                  "Members must be pointers to types derived from ISerializable");
+                    const auto member = members;
+                    pointers.push_back({ getMemberOffset<T>(member),
+                        [member](const ISerializable* obj) -> const ISerializable* { return static_cast<const T*>(obj)->*member; },
+                        [member](ISerializable* obj, ISerializable* target) { static_cast<T*>(obj)->*member = dynamic_cast<Target*>(target); } });
+                }(), ...);
+            setPointerLayout(typeid(T).hash_code(), std::move(pointers));
+        }
+
         template <typename T>
         bool addObject(T* obj)
         {
@@ -115,6 +342,9 @@ namespace ObjectSerializer
 			return true;
         }
 
+        // Size of the registered type of obj, 0 if the type is not registered
+        static std::size_t getObjectSize(const ISerializable* obj);
+
 		const std::vector<ISerializable*>& getObjects() const
 		{
 			return m_objs;
@@ -125,23 +355,369 @@ namespace ObjectSerializer
         }
 
         bool saveToFile(const std::string& filename) const;
+        [[nodiscard]] std::future<bool> checkpointToFile(const std::string& filename) const;
 		bool loadFromFile(const std::string& filename);
+        bool saveTo(IDataSink& sink) const;
+        bool loadFrom(IDataSource& source);
+
+        bool loadFromFile(const std::string& filename, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const;
+        bool loadFromFile(const std::string& filename, const FileIndex& index, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const;
+        bool loadFromFile(const std::string& filename, const BloomFilter& filter, std::size_t objectID, ISerializableID*& obj) const;
+        bool loadFromFile(const std::string& filename, const BloomFilter& filter, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const;
+        bool loadRange(const std::string& filename, std::size_t lowID, std::size_t highID, std::vector<ISerializableID*>& objs) const;
 
-        static bool saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs);
-        static bool loadFromFile(const std::string& filename, std::vector<ISerializable*>& objs);
+        bool removeFromFile(const std::string& filename, std::size_t objectID) const;
+        bool removeFromFile(const std::string& filename, FileIndex& index, std::size_t objectID) const;
+        bool addToFile(const std::string& filename, const ISerializableID* obj) const;
+        bool addToFile(const std::string& filename, FileIndex& index, const ISerializableID* obj) const;
+        bool compactFile(const std::string& filename) const;
+        std::future<bool> compactFileAsync(const std::string& filename) const;
+
+        static bool saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs, const Settings& settings = getDefaultSettings());
+        // Encodes the objects into memory before it returns and writes them to the file
+        // on a background thread. The objects must not change during the call, but can
+        // change again once it returned. The future holds the result of the write,
+        // its destructor waits until the write is done.
+        [[nodiscard]] static std::future<bool> checkpointToFile(const std::string& filename, const std::vector<ISerializable*>& objs, const Settings& settings = getDefaultSettings());
+        static bool loadFromFile(const std::string& filename, std::vector<ISerializable*>& objs, const Settings& settings = getDefaultSettings());
+        static bool saveTo(IDataSink& sink, const std::vector<ISerializable*>& objs, const Settings& settings = getDefaultSettings());
+        static bool loadFrom(IDataSource& source, std::vector<ISerializable*>& objs, const Settings& settings = getDefaultSettings());
 		
-        static bool overrideInFile(const std::string& filename, const ISerializableID* obj);
-        static bool loadFromFile(const std::string& filename, std::size_t objectID, ISerializableID*& obj);
+        // No per-instance overloads, they would make these ambiguous.
+        // Pass getSettings() to use the settings of an instance.
+        static bool overrideInFile(const std::string& filename, const ISerializableID* obj, const Settings& settings = getDefaultSettings());
+        static bool loadFromFile(const std::string& filename, std::size_t objectID, ISerializableID*& obj, const Settings& settings = getDefaultSettings());
+
+        // Loads the objects with the given IDs in one pass over the file.
+        // objs[i] is the object with objectIDs[i] or nullptr if it is not in the file.
+        static bool loadFromFile(const std::string& filename, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings);
+        // Same as above but reads only the requested records, ordered by their position
+        // in the file. Records that lie close to each other are read at once.
+        static bool loadFromFile(const std::string& filename, const FileIndex& index, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings);
+        // Same as the lookups above, but IDs which are certainly not in the file
+        // according to the filter of the file are not searched for
+        static bool loadFromFile(const std::string& filename, const BloomFilter& filter, std::size_t objectID, ISerializableID*& obj, const Settings& settings);
+        static bool loadFromFile(const std::string& filename, const BloomFilter& filter, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings);
+        // Loads the objects with lowID <= ID <= highID.
+        // Files saved with a sparse index are read only from the first possible record
+        // up to the first record behind highID, the objects are then ordered by ID.
+        // Other files are scanned completely and the objects are in file order.
+        static bool loadRange(const std::string& filename, std::size_t lowID, std::size_t highID, std::vector<ISerializableID*>& objs, const Settings& settings);
+
+        // Marks the record of the object as deleted. Loaders skip deleted records.
+        // The space gets reused by addToFile() for an object of the same type
+        // and released by compactFile().
+        static bool removeFromFile(const std::string& filename, std::size_t objectID, const Settings& settings);
+        static bool removeFromFile(const std::string& filename, FileIndex& index, std::size_t objectID, const Settings& settings);
+        // Adds an object to the file, into the space of a deleted object of the same
+        // type if there is one, otherwise at the end. The file is created if it does not exist.
+        // The ID must not be in the file yet, use overrideInFile() to change stored objects.
+        static bool addToFile(const std::string& filename, const ISerializableID* obj, const Settings& settings);
+        static bool addToFile(const std::string& filename, FileIndex& index, const ISerializableID* obj, const Settings& settings);
+        // Writes the file without deleted records to a temporary file, syncs it and replaces
+        // the original with it. SyncPolicy::Full also syncs the directory after the rename.
+        // Writes of other threads through this class wait for it.
+        // Fails without changing anything if another process modified the file in the
+        // meantime or a record can't be read. Indexes of the file must be rebuilt afterwards.
+        static bool compactFile(const std::string& filename, const Settings& settings);
+        static std::future<bool> compactFileAsync(const std::string& filename, const Settings& settings);
+        // True if the file ends with a sparse index, see Settings::sparseIndexInterval
+        static bool isSortedFile(const std::string& filename);
+
+        // Loads all objects of exactly type T into objs, in file order.
+        // Records of other types are skipped without decoding them.
+        template <typename T>
+        bool loadAllOfType(const std::string& filename, std::vector<T>& objs) const
+        {
+            return loadAllOfType<T>(filename, objs, m_settings);
+        }
+        template <typename T>
+        static bool loadAllOfType(const std::string& filename, std::vector<T>& objs, const Settings& settings)
+        {
+            static_assert(std::is_base_of<ISerializable, T>::value, "T must be derived from ISerializable");
+            objs.clear();
+            return readAllOfType(filename, typeid(T).hash_code(), [&objs]() -> ISerializable* { return &objs.emplace_back(); }, settings);
+        }
+        // Same as above but reads only the records of type T listed in the index.
+        // Records of the same type which are stored next to each other are read at once.
+        template <typename T>
+        bool loadAllOfType(const std::string& filename, const FileIndex& index, std::vector<T>& objs) const
+        {
+            return loadAllOfType<T>(filename, index, objs, m_settings);
+        }
+        template <typename T>
+        static bool loadAllOfType(const std::string& filename, const FileIndex& index, std::vector<T>& objs, const Settings& settings)
+        {
+            static_assert(std::is_base_of<ISerializable, T>::value, "T must be derived from ISerializable");
+            objs.clear();
+            return readAllOfType(filename, index, typeid(T).hash_code(), [&objs]() -> ISerializable* { return &objs.emplace_back(); }, settings);
+        }
+
+        // Saves a contiguous array of objects of type T as one block with a single header.
+        // The payloads are copied out of the array without per object lookups.
+        // Usage: saveArray<Particle>(sink, particles);
+        template <typename T>
+        bool saveArray(IDataSink& sink, std::span<const T> objs) const
+        {
+            return saveArray<T>(sink, objs, m_settings);
+        }
+        template <typename T>
+        bool saveArray(const std::string& filename, std::span<const T> objs) const
+        {
+            return saveArray<T>(filename, objs, m_settings);
+        }
+        template <typename T>
+        static bool saveArray(IDataSink& sink, std::span<const T> objs, const Settings& settings)
+        {
+            static_assert(std::is_base_of<ISerializable, T>::value, "T must be derived from ISerializable");
+            return writeArray(sink, typeid(T).hash_code(), reinterpret_cast<const char*>(objs.data()), sizeof(T), objs.size(), settings);
+        }
+        template <typename T>
+        static bool saveArray(const std::string& filename, std::span<const T> objs, const Settings& settings)
+        {
+            FileSink sink(filename);
+            if (!sink.isOpen())
+            {
+#if LOGGER_LIBRARY_AVAILABLE == 1
+                getLogger().logError("Failed to open file: " + filename);
+#endif
+                return false;
+            }
+            return saveArray<T>(sink, objs, settings);
+        }
+
+        // Loads a block written by saveArray<T>() into objs.
+        template <typename T>
+        bool loadArray(IDataSource& source, std::vector<T>& objs) const
+        {
+            return loadArray<T>(source, objs, m_settings);
+        }
+        template <typename T>
+        bool loadArray(const std::string& filename, std::vector<T>& objs) const
+        {
+            return loadArray<T>(filename, objs, m_settings);
+        }
+        template <typename T>
+        static bool loadArray(IDataSource& source, std::vector<T>& objs, const Settings& settings)
+        {
+            static_assert(std::is_base_of<ISerializable, T>::value, "T must be derived from ISerializable");
+            std::size_t count = 0;
+            objs.clear();
+            if (!readArrayHeader(source, typeid(T).hash_code(), count, settings))
+                return false;
+            // The count is not trusted, objects are only added once the bytes of the
+            // previous ones were read. A corrupt count fails at the end of the source.
+            std::size_t loaded = 0;
+            while (loaded < count)
+            {
+                const std::size_t batch = std::min(count - loaded, std::max(loaded, std::max<std::size_t>(1, s_bulkChunkSize / sizeof(T))));
+                objs.resize(loaded + batch);
+                if (!readArray(source, typeid(T).hash_code(), reinterpret_cast<char*>(objs.data() + loaded), sizeof(T), batch, settings))
+                {
+                    objs.resize(loaded);
+                    return false;
+                }
+                loaded += batch;
+            }
+            return true;
+        }
+        template <typename T>
+        static bool loadArray(const std::string& filename, std::vector<T>& objs, const Settings& settings)
+        {
+            FileSource source(filename);
+            if (!source.isOpen())
+            {
+#if LOGGER_LIBRARY_AVAILABLE == 1
+                getLogger().logError("Failed to open file: " + filename);
+#endif
+                return false;
+            }
+            return loadArray<T>(source, objs, settings);
+        }
+
+        // Loads only the records whose type is in types (all types if empty) and
+        // for which predicate returns true. Other records are skipped without
+        // creating an object for them.
+        bool scan(IDataSource& source, const std::vector<std::size_t>& types, const RecordPredicate& predicate, std::vector<ISerializable*>& objs) const
+        {
+            return scan(source, types, predicate, objs, m_settings);
+        }
+        static bool scan(IDataSource& source, const std::vector<std::size_t>& types, const RecordPredicate& predicate, std::vector<ISerializable*>& objs, const Settings& settings);
+
+        // Loads the objects of type T for which predicate returns true.
+        // The predicate sees a decoded temporary object, only matches get allocated.
+        template <typename T>
+        bool scan(IDataSource& source, const std::function<bool(const T&)>& predicate, std::vector<T*>& objs) const
+        {
+            return scan<T>(source, predicate, objs, m_settings);
+        }
+        template <typename T>
+        static bool scan(IDataSource& source, const std::function<bool(const T&)>& predicate, std::vector<T*>& objs, const Settings& settings)
+        {
+            static_assert(std::is_base_of<ISerializable, T>::value, "T must be derived from ISerializable");
+            T view;
+            std::vector<ISerializable*> matches;
+            bool success = scan(source, { typeid(T).hash_code() },
+                [&](std::size_t typeHash, const char* payload, std::size_t size)
+                {
+                    return decodeRecord(typeHash, payload, size, &view, settings) && predicate(view);
+                }, matches, settings);
+            objs.clear();
+            objs.reserve(matches.size());
+            for (ISerializable* obj : matches)
+                objs.push_back(static_cast<T*>(obj));
+            return success;
+        }
 
         private:
+        struct RecordRange
+        {
+            std::uint64_t offset;
+            std::size_t size;
+        };
+        // Returns the object into which the next record gets decoded
+        using ObjectAllocator = std::function<ISerializable*()>;
+
 		static bool isTypeRegistered(const std::size_t typeHash);
+        static bool getPayloadLayout(const ObjectMetaData& meta, const Settings& settings, PayloadLayout& layout);
+        static void setMemberLayout(const std::size_t typeHash, std::vector<FieldSpan>&& fields);
+        static void setPointerLayout(const std::size_t typeHash, std::vector<PointerMember>&& pointers);
+        static bool hasPointerMembers();
+        // True if one of the objects has a type with pointer members
+        static bool hasPointerMembers(const std::vector<ISerializable*>& objs);
+        // A record written on its own can't encode the targets of its pointers. For a record
+        // which replaces the one at offset of the file, the stored pointers get copied into it.
+        // Fails if the stored record has another type or size than the new one.
+        static bool keepStoredPointers(std::istream& file, std::uint64_t offset, char* record, std::size_t size, const Settings& settings);
+
+        static bool writePayload(IDataSink& sink, const ISerializable* obj, const PayloadLayout& layout);
+        static bool readPayload(IDataSource& source, ISerializable* obj, const PayloadLayout& layout);
+        static void decodePayload(const char* payload, ISerializable* obj, const PayloadLayout& layout);
+        static bool decodeRecord(std::size_t typeHash, const char* payload, std::size_t size, ISerializable* obj, const Settings& settings);
+
+        // Position of the ID inside the encoded payload
+        static bool getIDPosition(const ObjectMetaData& meta, const PayloadLayout& layout, std::size_t& position);
+        // Position of the object bytes [offset, offset + size) inside the encoded payload
+        static bool getFieldPosition(const PayloadLayout& layout, std::size_t offset, std::size_t size, std::size_t& position);
+        static bool readID(const char* payload, const ObjectMetaData& meta, const PayloadLayout& layout, std::size_t& id);
+
+        static std::size_t getRecordHeaderSize(const Settings& settings);
+        static void encodeRecordHeader(char* destination, std::size_t typeHash, std::size_t payloadSize, const Settings& settings);
+        static bool readRecordHeader(IDataSource& source, RecordHeader& header, const Settings& settings);
+        // Skips the payload of a record which does not get loaded.
+        // Returns false if the stream can not be continued.
+        static bool skipPayload(IDataSource& source, const RecordHeader& header, const ObjectMetaData* meta, const Settings& settings);
+        // Checks the framed payload size against the expected layout
+        static bool checkPayloadSize(const RecordHeader& header, const ObjectMetaData& meta, const PayloadLayout& layout, const Settings& settings);
+        // Record position + 1 of each saved object, pointer members store these
+        using PointerTable = std::unordered_map<const ISerializable*, std::uintptr_t>;
+        // Replaces the pointers in the payload by the positions of their targets, 0 for unknown targets
+        static void encodePointers(char* payload, const ISerializable* obj, const PayloadLayout& layout, const PointerTable* pointerTable);
+        static void clearPointers(ISerializable* obj, const PayloadLayout& layout);
+        struct WriteContext;
+        // context is set by saveTo(), which writes several runs of records into one block
+        static bool writeRecords(IDataSink& sink, const ISerializable* const* objs, std::size_t count, std::size_t typeHash, const PayloadLayout& layout, const Settings& settings, WriteContext* context = nullptr);
+        // Creates the file honoring atomicSave and syncPolicy, write fills it
+        static bool writeFile(const std::string& filename, const std::function<bool(IDataSink&)>& write, const Settings& settings);
+        // Encodes the objects into chunks which get written in order. Large sets are
+        // encoded on several threads if no record refers to another one.
+        static bool stageRecords(const std::vector<ISerializable*>& objs, const Settings& settings, std::vector<std::vector<char>>& chunks);
+        static constexpr std::size_t s_minStageChunkCount = 16 * 1024;
+        // Thread local buffer with at least size bytes, reused between calls
+        static char* getScratchBuffer(std::size_t size);
+        static constexpr std::size_t s_bulkChunkSize = 64 * 1024;
+        // Buffer size of ReadAheadSource in loadFromFile(), smaller files are read directly
+        static constexpr std::size_t s_readAheadBufferSize = 1024 * 1024;
+        // Indexed reads of records which are less than this apart get merged into one read
+        static constexpr std::size_t s_readCoalesceGap = 4 * 1024;
+        static constexpr std::size_t s_maxCoalescedRead = 1024 * 1024;
+        // Reads the records in ranges, which must be sorted by offset, and calls
+        // onRecord with the index of the range and the record bytes.
+        static bool readRecordRanges(std::ifstream& file, const std::vector<RecordRange>& ranges, const std::function<void(std::size_t, const char*)>& onRecord);
+        static bool readAllOfType(const std::string& filename, std::size_t typeHash, const ObjectAllocator& allocate, const Settings& settings);
+        static bool readAllOfType(const std::string& filename, const FileIndex& index, std::size_t typeHash, const ObjectAllocator& allocate, const Settings& settings);
+
+        // Array blocks: [typeHash][count][payloadSize] followed by count payloads
+        static bool writeArray(IDataSink& sink, std::size_t typeHash, const char* objs, std::size_t stride, std::size_t count, const Settings& settings);
+        static bool readArrayHeader(IDataSource& source, std::size_t typeHash, std::size_t& count, const Settings& settings);
+        static bool readArray(IDataSource& source, std::size_t typeHash, char* objs, std::size_t stride, std::size_t count, const Settings& settings);
+        // Strided copies between count objects, stride bytes apart, and densely packed payloads
+        static void gatherPayloads(char* destination, const char* objs, std::size_t stride, std::size_t count, const PayloadLayout& layout);
+        static void scatterPayloads(char* objs, const char* source, std::size_t stride, std::size_t count, const PayloadLayout& layout);
+
+        // Deleted records keep their size and store the inverted type hash
+        static std::size_t getTombstoneHash(std::size_t typeHash) { return ~typeHash; }
+        static const ObjectMetaData* findTombstoneType(std::size_t typeHash);
+        static bool findFreeSlot(std::istream& stream, std::size_t typeHash, const Settings& settings, std::uint64_t& offset);
+        static bool writeRecordAt(std::fstream& file, std::uint64_t offset, const ISerializableID* obj, std::size_t& typeHash, const Settings& settings);
+
+        // Duplicate records store the position of the original record and this type hash
+        static constexpr std::size_t s_referenceMask = static_cast<std::size_t>(0x5245464552454E43ULL); // "REFERENC"
+        static std::size_t getReferenceHash(std::size_t typeHash) { return typeHash ^ s_referenceMask; }
+        static const ObjectMetaData* findReferenceType(std::size_t typeHash);
+        static std::uint64_t hashPayload(const char* payload, std::size_t size);
+        // Copies the payload members of one object into another of the same type
+        static void copyPayload(const ISerializable* source, ISerializable* destination, const PayloadLayout& layout);
+
+        // Sorted files end with a sparse index behind the records:
+        // [magic][count][count * (id, offset)][index offset][magic]
+        // Loaders stop reading records at the magic.
+        static constexpr std::uint64_t s_sparseIndexMagic = 0x003130585053534FULL; // "OSSPX01"
+        struct SparseIndexEntry
+        {
+            std::uint64_t id;
+            std::uint64_t offset;
+        };
+        // Objects without ID first, then the others ordered by ID
+        static void sortByID(const std::vector<ISerializable*>& objs, std::vector<ISerializable*>& sorted);
+        static bool writeSparseIndex(IDataSink& sink, const std::vector<SparseIndexEntry>& entries, std::uint64_t indexOffset);
+
+        struct StoredPayload
+        {
+            std::size_t typeHash;
+            std::uintptr_t position;
+            std::size_t dataOffset;
+            std::size_t size;
+        };
+        struct WriteContext
+        {
+            PointerTable pointerTable;
+            bool hasPointers = false;
+            std::uintptr_t position = 0; // Records written so far
+            std::uint64_t offset = 0;    // Bytes written so far
+
+            std::size_t sparseIndexInterval = 0;
+            std::size_t indexedCount = 0;
+            std::vector<SparseIndexEntry> sparseIndex;
+
+            // Payload hash -> records written with that hash, their payloads are in payloadData
+            bool deduplicate = false;
+            std::unordered_multimap<std::uint64_t, StoredPayload> payloads;
+            std::vector<char> payloadData;
+        };
+        // Returns true and the position of the original record if the payload was written before.
+        // Otherwise the payload is remembered as the one of the next record.
+        static bool findDuplicate(WriteContext& context, std::size_t typeHash, const char* payload, std::size_t size, std::uint64_t& position);
+        // Binary searches the sparse index for the position behind which all objects
+        // with an ID >= id are stored. Returns false if the file has no sparse index.
+        static bool findSparseStart(std::istream& file, std::size_t id, std::uint64_t& offset);
+        // Reads the footer of a sorted file. Returns false if the file has no sparse index.
+        static bool findSparseIndex(std::istream& file, std::uint64_t& indexOffset, std::uint64_t& count);
+
+        // Held by the functions which change a file in place and by compactFile(),
+        // so that no write gets lost when the compacted copy replaces the file.
+        // Only guards against other threads of this process, files can share a mutex.
+        static std::mutex& getFileMutex(const std::string& filename);
+        // "<file><suffix>.<process>.<count>", unique across the threads and processes writing the file
+        static std::string getTempFilename(const std::string& filename, const std::string& suffix);
 
 		static void typeWithHashNotRegistered(const std::size_t typeHash);
 		static void typeNotRegistered(const ISerializable* obj);
 
-        static bool setCursorToID(std::fstream& file, std::size_t id);
+        static bool setCursorToID(std::fstream& file, std::size_t id, const Settings& settings);
 		
         std::vector<ISerializable*> m_objs;
+        Settings m_settings;
 
 		static std::unordered_map<std::size_t, ObjectMetaData>& getObjectMetaData();
     };
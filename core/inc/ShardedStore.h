@@ -0,0 +1,81 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "Serializer.h"
+#include "BloomFilter.h"
+
+#include <memory>
+#include <shared_mutex>
+
+namespace ObjectSerializer
+{
+    // Stores objects with IDs in several files (shards), partitioned by their ID.
+    // A manifest file describes the shard set, the shards are stored next to it
+    // as "<manifest>.<shard index>". Saving, loading and lookups of several objects
+    // run on one thread per shard. Updates of objects in different shards do not block each other.
+    // All shards are written with the same Serializer::Settings.
+    // Each shard has a BloomFilter stored as "<shard>.bloom", lookups skip shards
+    // which certainly do not contain the ID. Writes of single objects update the filter in
+    // memory and remove the stored one, save(), flush() and the destructor store it again.
+    // Loads share the lock of a shard, they never see a record being written by this store.
+    class OBJECT_SERIALIZER_API ShardedStore
+    {
+        public:
+        enum class Partitioning
+        {
+            Hash, // Spreads the IDs evenly over all shards
+            Range // Shard i holds the IDs [i * rangeSize, (i + 1) * rangeSize), the last shard all above
+        };
+
+        ShardedStore(const std::string& manifestFilename);
+        ShardedStore(const std::string& manifestFilename, const Serializer::Settings& settings);
+        ~ShardedStore();
+
+        // Defines a new shard set and writes its manifest. Existing shard files are cleared.
+        // shardCount must be in [1, s_maxShardCount], rangeSize > 0 for Partitioning::Range.
+        bool create(std::size_t shardCount, Partitioning partitioning = Partitioning::Hash, std::size_t rangeSize = 0);
+        // Reads the manifest of an existing shard set.
+        // Missing or outdated shard filters are rebuilt.
+        bool open();
+
+        // Replaces the content of all shards with objs
+        bool save(const std::vector<ISerializableID*>& objs);
+        // Loads the objects of all shards, shard by shard
+        bool load(std::vector<ISerializable*>& objs) const;
+
+        bool loadFromFile(std::size_t objectID, ISerializableID*& obj) const;
+        // objs[i] is the object with objectIDs[i] or nullptr if it does not exist
+        bool loadFromFile(std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const;
+        bool overrideInFile(const ISerializableID* obj);
+        bool addToFile(const ISerializableID* obj);
+        bool removeFromFile(std::size_t objectID);
+        // Stores the filters of the shards changed since they were last stored
+        bool flush();
+
+        std::size_t getShardCount() const { return m_shards.size(); }
+        std::size_t getShardIndex(std::size_t objectID) const;
+        const std::string& getShardFilename(std::size_t shardIndex) const { return m_shards[shardIndex]; }
+        Partitioning getPartitioning() const { return m_partitioning; }
+
+        static constexpr std::size_t s_maxShardCount = 1024;
+
+        private:
+        bool writeManifest() const;
+        void setShardCount(std::size_t shardCount);
+        // Must be called with the exclusive lock of the shard
+        bool saveFilter(std::size_t shard);
+        // Removes the stored filter before the first write into the shard since it was stored
+        bool invalidateFilter(std::size_t shard);
+
+        std::string m_manifestFilename;
+        Serializer::Settings m_settings;
+        Partitioning m_partitioning;
+        std::size_t m_rangeSize;
+        std::vector<std::string> m_shards;
+        // One lock per shard, held exclusively by the functions which write into a shard
+        std::unique_ptr<std::shared_mutex[]> m_shardMutexes;
+        std::vector<BloomFilter> m_filters;
+        // Nonzero for shards whose stored filter got removed, one byte per shard so that
+        // shards can be written concurrently
+        std::vector<std::uint8_t> m_staleFilters;
+    };
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "ObjectSerializer_base.h"
+#include "DataSink.h"
+#include "DataSource.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ObjectSerializer
+{
+    // Named shared memory segment which holds one serialized snapshot.
+    // The segment starts with a header, the snapshot bytes follow it.
+    // The generation is odd while a snapshot gets written and even once it is complete.
+    class OBJECT_SERIALIZER_API SharedMemorySegment
+    {
+        public:
+        struct Header
+        {
+            std::uint64_t magic;
+            std::atomic<std::uint64_t> generation;
+            std::uint64_t capacity;
+            std::atomic<std::uint64_t> size;
+        };
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "The generation must be lock free to be shared between processes");
+
+        SharedMemorySegment();
+        ~SharedMemorySegment();
+        SharedMemorySegment(const SharedMemorySegment&) = delete;
+        SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+
+        // Creates the segment or opens an existing one with at least capacity bytes
+        bool create(const std::string& name, std::size_t capacity);
+        // Opens an existing segment read only
+        bool open(const std::string& name);
+        void close();
+        bool isOpen() const { return m_header != nullptr; }
+
+        Header* getHeader() const { return m_header; }
+        char* getData() const { return m_data; }
+        // Snapshot bytes mapped by this process
+        std::size_t getCapacity() const { return m_header ? m_mappingSize - sizeof(Header) : 0; }
+
+        // Removes the name, mapped segments stay valid until they are closed.
+        // Does nothing on Windows, where the segment is gone with its last handle.
+        static bool remove(const std::string& name);
+        private:
+        bool map(std::size_t mappingSize, bool writable);
+
+        Header* m_header;
+        char* m_data;
+        std::size_t m_mappingSize;
+#ifdef _WIN32
+        void* m_handle;
+#else
+        int m_fd;
+#endif
+    };
+
+    // Writes snapshots into a shared memory segment, which other processes read with SharedMemorySource.
+    // Each snapshot gets written between begin() and commit(), writes which exceed the capacity fail.
+    //   sink.begin();
+    //   Serializer::saveTo(sink, objs, settings);
+    //   sink.commit();
+    class OBJECT_SERIALIZER_API SharedMemorySink : public IDataSink
+    {
+        public:
+        SharedMemorySink(const std::string& name, std::size_t capacity);
+
+        // Starts a new snapshot, readers of the previous one notice the change
+        void begin();
+        bool write(const char* data, std::size_t size) override;
+        // Publishes the written bytes. Returns false if a write failed since begin().
+        bool commit();
+
+        std::uint64_t getGeneration() const;
+        std::size_t getCapacity() const { return m_segment.getCapacity(); }
+        bool isOpen() const { return m_segment.isOpen(); }
+        private:
+        SharedMemorySegment m_segment;
+        std::size_t m_position;
+        bool m_writing;
+        bool m_failed;
+    };
+
+    // Reads the snapshots of a SharedMemorySink without copying them.
+    // The writer does not wait for readers: decode the snapshot between beginRead() and
+    // endRead() and discard the result if endRead() returns false, the snapshot changed then.
+    class OBJECT_SERIALIZER_API SharedMemorySource : public IDataSource
+    {
+        public:
+        SharedMemorySource(const std::string& name);
+
+        // Returns false while no complete snapshot is available
+        bool beginRead();
+        bool endRead() const;
+        // True if a newer snapshot than the last one read was committed
+        bool hasUpdate() const;
+
+        bool read(char* data, std::size_t size) override;
+        bool skip(std::size_t size) override;
+
+        // The mapped bytes of the current snapshot
+        std::span<const char> getView() const { return { m_segment.getData(), m_size }; }
+        std::uint64_t getGeneration() const { return m_generation; }
+        bool isOpen() const { return m_segment.isOpen(); }
+        private:
+        SharedMemorySegment m_segment;
+        std::uint64_t m_generation;
+        std::size_t m_size;
+        std::size_t m_position;
+    };
+}
@@ -0,0 +1,220 @@
+#include "BloomFilter.h"
+#include "FileIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// "OSBLM03" in little endian
+		constexpr std::uint64_t s_bloomFilterMagic = 0x0033304D4C42534FULL;
+		// Header: [magic][data size][data time][content hashed][content hash][hash count]
+		constexpr std::size_t s_headerWordCount = 6;
+		constexpr std::size_t s_maxHashCount = 16;
+
+		std::uint64_t mix(std::uint64_t value)
+		{
+			value += 0x9e3779b97f4a7c15ULL;
+			value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+			return value ^ (value >> 31);
+		}
+
+		bool getFileStamp(const std::string& filename, std::uint64_t& size, std::int64_t& time)
+		{
+			std::error_code error;
+			size = static_cast<std::uint64_t>(std::filesystem::file_size(filename, error));
+			if (error)
+				return false;
+			time = static_cast<std::int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+			return !error;
+		}
+		// Size and time miss changes within the resolution of the file time which keep
+		// the size, like an object added into the space of a removed one
+		bool getContentHash(const std::string& filename, std::uint64_t& hash)
+		{
+			std::ifstream file(filename, std::ios::binary);
+			if (!file.is_open())
+				return false;
+			std::vector<char> buffer(1024 * 1024);
+			hash = 0;
+			while (file)
+			{
+				file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+				const std::size_t size = static_cast<std::size_t>(file.gcount());
+				std::size_t i = 0;
+				for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+				{
+					std::uint64_t word;
+					std::memcpy(&word, buffer.data() + i, sizeof(word));
+					hash = mix(hash ^ word);
+				}
+				for (; i < size; ++i)
+					hash = mix(hash ^ static_cast<unsigned char>(buffer[i]));
+			}
+			return file.eof();
+		}
+	}
+
+	BloomFilter::BloomFilter()
+		: m_hashCount(0)
+	{
+
+	}
+	BloomFilter::BloomFilter(std::size_t expectedCount, double falsePositiveRate)
+		: m_hashCount(0)
+	{
+		reset(expectedCount, falsePositiveRate);
+	}
+
+	void BloomFilter::reset(std::size_t expectedCount, double falsePositiveRate)
+	{
+		const double ln2 = std::log(2.0);
+		const double count = static_cast<double>(std::max<std::size_t>(1, expectedCount));
+		const double rate = std::clamp(falsePositiveRate, 1e-9, 0.5);
+		const double bits = std::ceil(-count * std::log(rate) / (ln2 * ln2));
+		m_bits.assign(std::max<std::size_t>(1, static_cast<std::size_t>(bits / 64) + 1), 0);
+		const double hashes = std::round(static_cast<double>(getBitCount()) / count * ln2);
+		m_hashCount = std::clamp<std::size_t>(static_cast<std::size_t>(hashes), 1, s_maxHashCount);
+	}
+	void BloomFilter::clear()
+	{
+		m_bits.clear();
+		m_hashCount = 0;
+	}
+
+	void BloomFilter::insert(std::size_t objectID)
+	{
+		if (m_bits.empty())
+			return;
+		// Double hashing: bit i = h1 + i * h2
+		const std::uint64_t h1 = mix(objectID);
+		const std::uint64_t h2 = mix(h1) | 1;
+		const std::uint64_t bitCount = getBitCount();
+		for (std::size_t i = 0; i < m_hashCount; ++i)
+		{
+			const std::uint64_t bit = (h1 + i * h2) % bitCount;
+			m_bits[bit / 64] |= std::uint64_t(1) << (bit % 64);
+		}
+	}
+	bool BloomFilter::mightContain(std::size_t objectID) const
+	{
+		if (m_bits.empty())
+			return true;
+		const std::uint64_t h1 = mix(objectID);
+		const std::uint64_t h2 = mix(h1) | 1;
+		const std::uint64_t bitCount = getBitCount();
+		for (std::size_t i = 0; i < m_hashCount; ++i)
+		{
+			const std::uint64_t bit = (h1 + i * h2) % bitCount;
+			if (!(m_bits[bit / 64] & (std::uint64_t(1) << (bit % 64))))
+				return false;
+		}
+		return true;
+	}
+
+	bool BloomFilter::build(const std::string& dataFilename, const Serializer::Settings& settings, double falsePositiveRate)
+	{
+		FileIndex index;
+		if (!index.build(dataFilename, settings))
+		{
+			clear();
+			return false;
+		}
+		reset(index.size(), falsePositiveRate);
+		for (const auto& entry : index.getEntries())
+			insert(entry.first);
+		return true;
+	}
+
+	bool BloomFilter::saveToFile(const std::string& filterFilename, const std::string& dataFilename, bool hashContent) const
+	{
+		std::uint64_t dataSize = 0;
+		std::int64_t dataTime = 0;
+		std::uint64_t dataHash = 0;
+		if (!getFileStamp(dataFilename, dataSize, dataTime) || (hashContent && !getContentHash(dataFilename, dataHash)))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + dataFilename);
+#endif
+			return false;
+		}
+
+		// Readers see either the old or the new filter, never a partly written one
+		const std::string tempFilename = filterFilename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary);
+			if (!file.is_open())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to open file: " + tempFilename);
+#endif
+				return false;
+			}
+			const std::uint64_t header[s_headerWordCount] = { s_bloomFilterMagic, dataSize, static_cast<std::uint64_t>(dataTime), hashContent ? 1u : 0u, dataHash, m_hashCount };
+			const std::uint64_t wordCount = m_bits.size();
+			file.write(reinterpret_cast<const char*>(header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(&wordCount), sizeof(wordCount));
+			file.write(reinterpret_cast<const char*>(m_bits.data()), static_cast<std::streamsize>(m_bits.size() * sizeof(std::uint64_t)));
+			file.close();
+			if (!file)
+			{
+				std::error_code error;
+				std::filesystem::remove(tempFilename, error);
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tempFilename, filterFilename, error);
+		if (error)
+		{
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		return true;
+	}
+	bool BloomFilter::loadFromFile(const std::string& filterFilename, const std::string& dataFilename)
+	{
+		clear();
+		std::ifstream file(filterFilename, std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		std::uint64_t header[s_headerWordCount] = { 0 };
+		std::uint64_t wordCount = 0;
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		file.read(reinterpret_cast<char*>(&wordCount), sizeof(wordCount));
+		std::uint64_t dataSize = 0;
+		std::int64_t dataTime = 0;
+		std::uint64_t dataHash = 0;
+		if (!file || header[0] != s_bloomFilterMagic || header[3] > 1 || header[5] == 0 || header[5] > s_maxHashCount)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("File is not a bloom filter: " + filterFilename);
+#endif
+			return false;
+		}
+		if (!getFileStamp(dataFilename, dataSize, dataTime) ||
+			header[1] != dataSize || header[2] != static_cast<std::uint64_t>(dataTime) ||
+			(header[3] && (!getContentHash(dataFilename, dataHash) || header[4] != dataHash)))
+		{
+			// The data file changed, the filter may miss IDs
+			return false;
+		}
+
+		std::error_code error;
+		if (wordCount > (std::filesystem::file_size(filterFilename, error) - sizeof(header) - sizeof(wordCount)) / sizeof(std::uint64_t) || error)
+			return false;
+		std::vector<std::uint64_t> bits(static_cast<std::size_t>(wordCount));
+		file.read(reinterpret_cast<char*>(bits.data()), static_cast<std::streamsize>(bits.size() * sizeof(std::uint64_t)));
+		if (!file)
+			return false;
+		m_bits = std::move(bits);
+		m_hashCount = static_cast<std::size_t>(header[5]);
+		return true;
+	}
+}
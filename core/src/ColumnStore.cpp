@@ -0,0 +1,295 @@
+#include "ColumnStore.h"
+#include "ISerializable.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// "OSCOL01" in little endian
+		constexpr std::uint64_t s_columnStoreMagic = 0x0031304C4F43534FULL;
+		constexpr std::size_t s_columnChunkSize = 64 * 1024;
+
+		struct MemberColumn
+		{
+			std::uint64_t offset;
+			std::uint64_t size;
+			std::uint64_t dataOffset;
+		};
+		struct TypeColumns
+		{
+			std::uint64_t typeHash;
+			std::uint64_t rowCount;
+			std::vector<MemberColumn> members;
+		};
+
+		bool readHeader(std::istream& stream, std::vector<TypeColumns>& types)
+		{
+			stream.seekg(0, std::ios::end);
+			const std::uint64_t fileSize = static_cast<std::uint64_t>(stream.tellg());
+			stream.seekg(0, std::ios::beg);
+
+			std::uint64_t magic = 0;
+			std::uint64_t typeCount = 0;
+			stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+			stream.read(reinterpret_cast<char*>(&typeCount), sizeof(typeCount));
+			// Counts of a corrupt header must not exceed what the file can hold
+			std::uint64_t remaining = fileSize - 2 * sizeof(std::uint64_t);
+			if (!stream || magic != s_columnStoreMagic || typeCount > remaining / (3 * sizeof(std::uint64_t)))
+				return false;
+
+			types.resize(static_cast<std::size_t>(typeCount));
+			for (TypeColumns& type : types)
+			{
+				std::uint64_t memberCount = 0;
+				stream.read(reinterpret_cast<char*>(&type.typeHash), sizeof(type.typeHash));
+				stream.read(reinterpret_cast<char*>(&type.rowCount), sizeof(type.rowCount));
+				stream.read(reinterpret_cast<char*>(&memberCount), sizeof(memberCount));
+				remaining -= 3 * sizeof(std::uint64_t);
+				if (!stream || memberCount > remaining / sizeof(MemberColumn))
+					return false;
+				remaining -= memberCount * sizeof(MemberColumn);
+				type.members.resize(static_cast<std::size_t>(memberCount));
+				stream.read(reinterpret_cast<char*>(type.members.data()), static_cast<std::streamsize>(memberCount * sizeof(MemberColumn)));
+				for (const MemberColumn& member : type.members)
+				{
+					if (member.size == 0)
+						return false;
+				}
+			}
+			return static_cast<bool>(stream);
+		}
+		bool readHeader(const std::string& filename, std::ifstream& file, std::vector<TypeColumns>& types)
+		{
+			file.open(filename, std::ios::binary);
+			if (!file.is_open())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to open file: " + filename);
+#endif
+				return false;
+			}
+			if (!readHeader(file, types))
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("File is not a column store: " + filename);
+#endif
+				return false;
+			}
+			return true;
+		}
+		const TypeColumns* findType(const std::vector<TypeColumns>& types, std::size_t typeHash)
+		{
+			for (const TypeColumns& type : types)
+				if (type.typeHash == typeHash)
+					return &type;
+			return nullptr;
+		}
+	}
+
+	bool ColumnStore::saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs)
+	{
+		FileSink sink(filename);
+		if (!sink.isOpen())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+		return saveTo(sink, objs);
+	}
+	bool ColumnStore::saveTo(IDataSink& sink, const std::vector<ISerializable*>& objs)
+	{
+		const auto& metaMap = Serializer::getObjectMetaData();
+
+		// Group the objects by type, in order of first appearance
+		std::vector<std::pair<const Serializer::ObjectMetaData*, std::vector<const char*>>> groups;
+		std::unordered_map<std::size_t, std::size_t> groupIndex;
+		for (const ISerializable* obj : objs)
+		{
+			std::size_t typeHash = typeid(*obj).hash_code();
+			auto indexIt = groupIndex.find(typeHash);
+			if (indexIt == groupIndex.end())
+			{
+				const auto& metaIt = metaMap.find(typeHash);
+				if (metaIt == metaMap.end())
+				{
+					Serializer::typeNotRegistered(obj);
+					continue;
+				}
+				if (metaIt->second.members.empty())
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					Serializer::getLogger().logError("Type has no registered members: " + metaIt->second.name);
+#endif
+					continue;
+				}
+				indexIt = groupIndex.insert({ typeHash, groups.size() }).first;
+				groups.push_back({ &metaIt->second, {} });
+			}
+			groups[indexIt->second].second.push_back(reinterpret_cast<const char*>(obj));
+		}
+
+		// Header
+		std::vector<TypeColumns> types(groups.size());
+		std::uint64_t dataOffset = 2 * sizeof(std::uint64_t);
+		for (const auto& group : groups)
+			dataOffset += 3 * sizeof(std::uint64_t) + group.first->members.size() * sizeof(MemberColumn);
+		for (std::size_t i = 0; i < groups.size(); ++i)
+		{
+			const Serializer::ObjectMetaData& meta = *groups[i].first;
+			types[i].typeHash = meta.typeHash;
+			types[i].rowCount = groups[i].second.size();
+			for (const auto& member : meta.members)
+			{
+				types[i].members.push_back({ member.offset, member.size, dataOffset });
+				dataOffset += member.size * groups[i].second.size();
+			}
+		}
+
+		const std::uint64_t magic = s_columnStoreMagic;
+		const std::uint64_t typeCount = types.size();
+		bool success = sink.write(reinterpret_cast<const char*>(&magic), sizeof(magic)) &&
+					   sink.write(reinterpret_cast<const char*>(&typeCount), sizeof(typeCount));
+		for (const TypeColumns& type : types)
+		{
+			const std::uint64_t memberCount = type.members.size();
+			success = success &&
+				sink.write(reinterpret_cast<const char*>(&type.typeHash), sizeof(type.typeHash)) &&
+				sink.write(reinterpret_cast<const char*>(&type.rowCount), sizeof(type.rowCount)) &&
+				sink.write(reinterpret_cast<const char*>(&memberCount), sizeof(memberCount)) &&
+				sink.write(reinterpret_cast<const char*>(type.members.data()), type.members.size() * sizeof(MemberColumn));
+		}
+
+		// Columns
+		std::vector<char> chunk;
+		for (const auto& group : groups)
+		{
+			const std::vector<const char*>& rows = group.second;
+			for (const auto& member : group.first->members)
+			{
+				const std::size_t rowsPerChunk = std::max<std::size_t>(1, s_columnChunkSize / member.size);
+				for (std::size_t first = 0; success && first < rows.size(); first += rowsPerChunk)
+				{
+					const std::size_t count = std::min(rowsPerChunk, rows.size() - first);
+					chunk.resize(count * member.size);
+					char* dst = chunk.data();
+					for (std::size_t i = first; i < first + count; ++i)
+					{
+						std::memcpy(dst, rows[i] + member.offset, member.size);
+						dst += member.size;
+					}
+					success = sink.write(chunk.data(), chunk.size());
+				}
+			}
+		}
+		if (!success)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to write column store");
+#endif
+		}
+		return success;
+	}
+
+	bool ColumnStore::getRowCount(const std::string& filename, std::size_t typeHash, std::size_t& count)
+	{
+		std::ifstream file;
+		std::vector<TypeColumns> types;
+		count = 0;
+		if (!readHeader(filename, file, types))
+			return false;
+		if (const TypeColumns* type = findType(types, typeHash))
+			count = static_cast<std::size_t>(type->rowCount);
+		return true;
+	}
+	bool ColumnStore::findColumn(const std::string& filename, std::size_t typeHash, std::size_t memberOffset, std::size_t memberSize, ColumnInfo& info)
+	{
+		std::ifstream file;
+		std::vector<TypeColumns> types;
+		if (!readHeader(filename, file, types))
+			return false;
+		const TypeColumns* type = findType(types, typeHash);
+		if (!type)
+		{
+			Serializer::typeWithHashNotRegistered(typeHash);
+			return false;
+		}
+		for (const MemberColumn& member : type->members)
+		{
+			if (member.offset == memberOffset && member.size == memberSize)
+			{
+				info.rowCount = static_cast<std::size_t>(type->rowCount);
+				info.size = static_cast<std::size_t>(member.size);
+				info.dataOffset = member.dataOffset;
+				return true;
+			}
+		}
+#if LOGGER_LIBRARY_AVAILABLE == 1
+		Serializer::getLogger().logError("No column stored for member at offset " + std::to_string(memberOffset) + " in file: " + filename);
+#endif
+		return false;
+	}
+	bool ColumnStore::readColumn(const std::string& filename, const ColumnInfo& info, std::size_t first, std::size_t count, char* destination)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		file.seekg(static_cast<std::streamoff>(info.dataOffset + first * info.size));
+		file.read(destination, static_cast<std::streamsize>(count * info.size));
+		return static_cast<bool>(file);
+	}
+	bool ColumnStore::readRows(const std::string& filename, std::size_t typeHash, std::size_t first, const std::vector<char*>& objects)
+	{
+		std::ifstream file;
+		std::vector<TypeColumns> types;
+		if (!readHeader(filename, file, types))
+			return false;
+		const TypeColumns* type = findType(types, typeHash);
+		if (!type)
+			return objects.empty();
+
+		std::vector<char> chunk;
+		for (const MemberColumn& member : type->members)
+		{
+			const std::size_t memberOffset = static_cast<std::size_t>(member.offset);
+			const std::size_t memberSize = static_cast<std::size_t>(member.size);
+			const std::size_t rowsPerChunk = std::max<std::size_t>(1, s_columnChunkSize / memberSize);
+			file.seekg(static_cast<std::streamoff>(member.dataOffset + first * memberSize));
+			for (std::size_t begin = 0; begin < objects.size(); begin += rowsPerChunk)
+			{
+				const std::size_t count = std::min(rowsPerChunk, objects.size() - begin);
+				chunk.resize(count * memberSize);
+				file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+				if (!file)
+					return false;
+				const char* src = chunk.data();
+				for (std::size_t i = begin; i < begin + count; ++i)
+				{
+					std::memcpy(objects[i] + memberOffset, src, memberSize);
+					src += memberSize;
+				}
+			}
+		}
+
+		// Stored pointer members hold addresses of the saving process
+		const auto& metaMap = Serializer::getObjectMetaData();
+		const auto& metaIt = metaMap.find(typeHash);
+		if (metaIt == metaMap.end())
+			return true;
+		for (const Serializer::PointerMember& pointer : metaIt->second.pointers)
+		{
+			const bool stored = std::any_of(type->members.begin(), type->members.end(), [&](const MemberColumn& member)
+				{
+					return pointer.offset >= member.offset && pointer.offset + sizeof(void*) <= member.offset + member.size;
+				});
+			for (std::size_t i = 0; stored && i < objects.size(); ++i)
+				std::memset(objects[i] + pointer.offset, 0, sizeof(void*));
+		}
+		return true;
+	}
+}
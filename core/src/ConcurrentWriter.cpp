@@ -0,0 +1,235 @@
+#include "ConcurrentWriter.h"
+
+#include <algorithm>
+#include <typeindex>
+
+namespace ObjectSerializer
+{
+	ConcurrentWriter::ConcurrentWriter(const std::string& filename)
+		: ConcurrentWriter(filename, Serializer::Settings())
+	{
+
+	}
+	ConcurrentWriter::ConcurrentWriter(const std::string& filename, const Serializer::Settings& settings)
+		: m_filename(filename)
+		, m_settings(settings)
+		, m_head(nullptr)
+		, m_open(false)
+		, m_producers(0)
+		, m_failed(false)
+	{
+
+	}
+	ConcurrentWriter::~ConcurrentWriter()
+	{
+		close();
+	}
+
+	bool ConcurrentWriter::open()
+	{
+		if (isOpen())
+			return true;
+		if (m_settings.sparseIndexInterval != 0 || Serializer::isSortedFile(m_filename))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Objects can't be added to the sorted file: " + m_filename);
+#endif
+			return false;
+		}
+		m_sink = std::make_unique<SyncFileSink>(m_filename, SyncFileSink::Mode::Append);
+		if (!m_sink->isOpen())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + m_filename);
+#endif
+			m_sink.reset();
+			return false;
+		}
+		m_failed = false;
+		m_thread = std::thread(&ConcurrentWriter::writeLoop, this);
+		m_open.store(true, std::memory_order_release);
+		return true;
+	}
+	bool ConcurrentWriter::close()
+	{
+		if (!m_thread.joinable())
+			return true;
+		m_open.store(false, std::memory_order_seq_cst);
+		// Producers which saw the writer open finish their push before the stop request
+		while (m_producers.load(std::memory_order_seq_cst) != 0)
+			std::this_thread::yield();
+		// The writer thread writes everything queued before the stop request
+		const bool success = request(true);
+		m_thread.join();
+		for (Node* node : m_freeNodes)
+			delete node;
+		m_freeNodes.clear();
+		m_sink.reset();
+		return success;
+	}
+
+	bool ConcurrentWriter::addObject(const ISerializable* obj)
+	{
+		if (!obj)
+			return false;
+		const auto& mataMap = Serializer::getObjectMetaData();
+		const std::size_t typeHash = std::type_index(typeid(*obj)).hash_code();
+		const auto& it = mataMap.find(typeHash);
+		if (it == mataMap.end())
+		{
+			Serializer::typeNotRegistered(obj);
+			return false;
+		}
+		Serializer::PayloadLayout layout;
+		if (!Serializer::getPayloadLayout(it->second, m_settings, layout) || !enter())
+			return false;
+
+		// The record is encoded into the buffer of a written node
+		Node* node = acquireNode();
+		BufferSink sink(node->record);
+		if (!Serializer::writeRecords(sink, &obj, 1, typeHash, layout, m_settings))
+		{
+			releaseNodes({ node });
+			leave();
+			return false;
+		}
+		push(node);
+		leave();
+		return true;
+	}
+	bool ConcurrentWriter::addRecord(std::vector<char>&& record)
+	{
+		if (!enter())
+			return false;
+		Node* node = acquireNode();
+		node->record = std::move(record);
+		push(node);
+		leave();
+		return true;
+	}
+	bool ConcurrentWriter::flush()
+	{
+		if (!enter())
+			return false;
+		const bool success = request(false);
+		leave();
+		return success;
+	}
+
+	bool ConcurrentWriter::enter()
+	{
+		// Sequentially consistent with close(): either close() sees the producer or the producer sees it closed
+		m_producers.fetch_add(1, std::memory_order_seq_cst);
+		if (m_open.load(std::memory_order_seq_cst))
+			return true;
+		leave();
+		return false;
+	}
+	void ConcurrentWriter::leave()
+	{
+		m_producers.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	ConcurrentWriter::Node* ConcurrentWriter::acquireNode()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_poolMutex);
+			if (!m_freeNodes.empty())
+			{
+				Node* node = m_freeNodes.back();
+				m_freeNodes.pop_back();
+				return node;
+			}
+		}
+		return new Node();
+	}
+	void ConcurrentWriter::releaseNodes(const std::vector<Node*>& nodes)
+	{
+		std::lock_guard<std::mutex> lock(m_poolMutex);
+		for (Node* node : nodes)
+		{
+			// Large buffers are not kept around
+			if (m_freeNodes.size() >= s_maxFreeNodes || node->record.capacity() > s_maxPooledRecordSize)
+			{
+				delete node;
+				continue;
+			}
+			node->next = nullptr;
+			node->record.clear();
+			node->done = nullptr;
+			node->stop = false;
+			m_freeNodes.push_back(node);
+		}
+	}
+
+	void ConcurrentWriter::push(Node* node)
+	{
+		Node* head = m_head.load(std::memory_order_relaxed);
+		do
+		{
+			node->next = head;
+		} while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+		// The writer only sleeps on an empty queue
+		if (!head)
+			m_head.notify_one();
+	}
+	bool ConcurrentWriter::request(bool stop)
+	{
+		std::promise<bool> done;
+		std::future<bool> result = done.get_future();
+		Node* node = acquireNode();
+		node->done = &done;
+		node->stop = stop;
+		push(node);
+		return result.get();
+	}
+	bool ConcurrentWriter::writeBatch(const std::vector<char>& batch)
+	{
+		if (batch.empty())
+			return true;
+		// Serializer::addToFile() of other threads writes behind the end of the file as well
+		std::lock_guard<std::mutex> lock(Serializer::getFileMutex(m_filename));
+		return m_sink->write(batch.data(), batch.size());
+	}
+	void ConcurrentWriter::writeLoop()
+	{
+		std::vector<char> batch;
+		std::vector<Node*> nodes;
+		bool stop = false;
+		while (!stop)
+		{
+			m_head.wait(nullptr, std::memory_order_acquire);
+			Node* head = m_head.exchange(nullptr, std::memory_order_acquire);
+			// The queue holds the newest node first
+			nodes.clear();
+			for (Node* node = head; node; node = node->next)
+				nodes.push_back(node);
+			std::reverse(nodes.begin(), nodes.end());
+
+			batch.clear();
+			for (Node* node : nodes)
+			{
+				if (!node->done)
+				{
+					batch.insert(batch.end(), node->record.begin(), node->record.end());
+					continue;
+				}
+				// Requests get answered after the records queued before them are written
+				if (!writeBatch(batch))
+					m_failed = true;
+				batch.clear();
+				if (m_settings.syncPolicy != Serializer::SyncPolicy::None && !m_sink->sync())
+					m_failed = true;
+				stop = stop || node->stop;
+				node->done->set_value(!m_failed);
+			}
+			if (!writeBatch(batch))
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to write to file: " + m_filename);
+#endif
+				m_failed = true;
+			}
+			releaseNodes(nodes);
+		}
+	}
+}
@@ -0,0 +1,273 @@
+#include "DataSink.h"
+
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ObjectSerializer
+{
+	BufferSink::BufferSink(std::vector<char>& buffer)
+		: m_buffer(buffer)
+	{
+
+	}
+	bool BufferSink::write(const char* data, std::size_t size)
+	{
+		m_buffer.insert(m_buffer.end(), data, data + size);
+		return true;
+	}
+
+
+	SpanSink::SpanSink(std::span<char> buffer)
+		: m_buffer(buffer)
+		, m_position(0)
+	{
+
+	}
+	bool SpanSink::write(const char* data, std::size_t size)
+	{
+		if (size > m_buffer.size() - m_position)
+			return false;
+		std::memcpy(m_buffer.data() + m_position, data, size);
+		m_position += size;
+		return true;
+	}
+
+
+	StreamSink::StreamSink(std::ostream& stream)
+		: m_stream(stream)
+	{
+
+	}
+	bool StreamSink::write(const char* data, std::size_t size)
+	{
+		m_stream.write(data, static_cast<std::streamsize>(size));
+		return m_stream.good();
+	}
+
+
+	FileSink::FileSink(const std::string& filename)
+		: m_file(filename, std::ios::binary)
+	{
+
+	}
+	bool FileSink::write(const char* data, std::size_t size)
+	{
+		m_file.write(data, static_cast<std::streamsize>(size));
+		return m_file.good();
+	}
+
+
+#ifdef _WIN32
+	SyncFileSink::SyncFileSink(const std::string& filename, Mode mode)
+		: m_handle(INVALID_HANDLE_VALUE)
+	{
+		DWORD disposition = OPEN_ALWAYS;
+		if (mode == Mode::Truncate)
+			disposition = CREATE_ALWAYS;
+		else if (mode == Mode::Update)
+			disposition = OPEN_EXISTING;
+		m_handle = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+							   nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_handle != INVALID_HANDLE_VALUE && mode == Mode::Append)
+		{
+			LARGE_INTEGER distance{};
+			SetFilePointerEx(m_handle, distance, nullptr, FILE_END);
+		}
+	}
+	SyncFileSink::~SyncFileSink()
+	{
+		close();
+	}
+	bool SyncFileSink::write(const char* data, std::size_t size)
+	{
+		while (size > 0)
+		{
+			DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30));
+			DWORD written = 0;
+			if (!WriteFile(m_handle, data, chunk, &written, nullptr))
+				return false;
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+	bool SyncFileSink::seek(std::uint64_t offset)
+	{
+		LARGE_INTEGER distance;
+		distance.QuadPart = static_cast<LONGLONG>(offset);
+		return SetFilePointerEx(m_handle, distance, nullptr, FILE_BEGIN) != 0;
+	}
+	bool SyncFileSink::sync()
+	{
+		return FlushFileBuffers(m_handle) != 0;
+	}
+	bool SyncFileSink::syncDirectory(const std::string& path)
+	{
+		// NTFS journals directory changes itself
+		OS_UNUSED(path);
+		return true;
+	}
+	bool SyncFileSink::isOpen() const
+	{
+		return m_handle != INVALID_HANDLE_VALUE;
+	}
+	void SyncFileSink::close()
+	{
+		if (m_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(m_handle);
+		m_handle = INVALID_HANDLE_VALUE;
+	}
+#else
+	SyncFileSink::SyncFileSink(const std::string& filename, Mode mode)
+		: m_fd(-1)
+	{
+		int flags = O_WRONLY;
+		if (mode == Mode::Truncate)
+			flags |= O_CREAT | O_TRUNC;
+		else if (mode == Mode::Append)
+			flags |= O_CREAT | O_APPEND;
+		m_fd = ::open(filename.c_str(), flags, 0644);
+	}
+	SyncFileSink::~SyncFileSink()
+	{
+		close();
+	}
+	bool SyncFileSink::write(const char* data, std::size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t written = ::write(m_fd, data, size);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			data += written;
+			size -= static_cast<std::size_t>(written);
+		}
+		return true;
+	}
+	bool SyncFileSink::seek(std::uint64_t offset)
+	{
+		return ::lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) >= 0;
+	}
+	bool SyncFileSink::sync()
+	{
+#if defined(__APPLE__)
+		return ::fsync(m_fd) == 0;
+#else
+		return ::fdatasync(m_fd) == 0;
+#endif
+	}
+	bool SyncFileSink::syncDirectory(const std::string& path)
+	{
+		int fd = ::open(path.empty() ? "." : path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		bool success = ::fsync(fd) == 0;
+		::close(fd);
+		return success;
+	}
+	bool SyncFileSink::isOpen() const
+	{
+		return m_fd >= 0;
+	}
+	void SyncFileSink::close()
+	{
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+	}
+#endif
+
+
+	BackgroundSink::BackgroundSink(IDataSink& target, std::size_t bufferSize)
+		: m_target(target)
+		, m_bufferSize(std::max<std::size_t>(1, bufferSize))
+		, m_hasWork(false)
+		, m_stop(false)
+		, m_failed(false)
+	{
+		m_buffer.reserve(m_bufferSize);
+	}
+	BackgroundSink::~BackgroundSink()
+	{
+		flush();
+		if (m_thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_signal.notify_all();
+			m_thread.join();
+		}
+	}
+	bool BackgroundSink::write(const char* data, std::size_t size)
+	{
+		while (size > 0)
+		{
+			std::size_t chunk = std::min(size, m_bufferSize - m_buffer.size());
+			m_buffer.insert(m_buffer.end(), data, data + chunk);
+			data += chunk;
+			size -= chunk;
+			if (m_buffer.size() >= m_bufferSize && !submit())
+				return false;
+		}
+		return true;
+	}
+	bool BackgroundSink::flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_signal.wait(lock, [this]() { return !m_hasWork; });
+		// The background thread is idle, the target can be used directly
+		if (!m_failed && !m_buffer.empty() && !m_target.write(m_buffer.data(), m_buffer.size()))
+			m_failed = true;
+		m_buffer.clear();
+		return !m_failed;
+	}
+	bool BackgroundSink::submit()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_signal.wait(lock, [this]() { return !m_hasWork; });
+		if (m_failed)
+			return false;
+		m_buffer.swap(m_writing);
+		m_buffer.clear();
+		m_buffer.reserve(m_bufferSize);
+		m_hasWork = true;
+		if (!m_thread.joinable())
+			m_thread = std::thread(&BackgroundSink::writeLoop, this);
+		lock.unlock();
+		m_signal.notify_all();
+		return true;
+	}
+	void BackgroundSink::writeLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_signal.wait(lock, [this]() { return m_hasWork || m_stop; });
+			if (!m_hasWork)
+				break;
+			lock.unlock();
+			bool success = m_target.write(m_writing.data(), m_writing.size());
+			lock.lock();
+			if (!success)
+				m_failed = true;
+			m_hasWork = false;
+			m_signal.notify_all();
+		}
+	}
+}
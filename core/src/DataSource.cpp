@@ -0,0 +1,186 @@
+#include "DataSource.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ObjectSerializer
+{
+	BufferSource::BufferSource(std::span<const char> buffer)
+		: m_buffer(buffer)
+		, m_position(0)
+	{
+
+	}
+	BufferSource::BufferSource(const std::vector<char>& buffer)
+		: m_buffer(buffer.data(), buffer.size())
+		, m_position(0)
+	{
+
+	}
+	bool BufferSource::read(char* data, std::size_t size)
+	{
+		if (size > getRemaining())
+		{
+			m_position = m_buffer.size();
+			return false;
+		}
+		std::memcpy(data, m_buffer.data() + m_position, size);
+		m_position += size;
+		return true;
+	}
+	bool BufferSource::skip(std::size_t size)
+	{
+		if (size > getRemaining())
+		{
+			m_position = m_buffer.size();
+			return false;
+		}
+		m_position += size;
+		return true;
+	}
+
+
+	StreamSource::StreamSource(std::istream& stream)
+		: m_stream(stream)
+	{
+
+	}
+	bool StreamSource::read(char* data, std::size_t size)
+	{
+		m_stream.read(data, static_cast<std::streamsize>(size));
+		return static_cast<bool>(m_stream);
+	}
+	bool StreamSource::skip(std::size_t size)
+	{
+		m_stream.ignore(static_cast<std::streamsize>(size));
+		return static_cast<std::size_t>(m_stream.gcount()) == size;
+	}
+
+
+	FileSource::FileSource(const std::string& filename)
+		: m_file(filename, std::ios::binary)
+	{
+
+	}
+	bool FileSource::read(char* data, std::size_t size)
+	{
+		m_file.read(data, static_cast<std::streamsize>(size));
+		return static_cast<bool>(m_file);
+	}
+	bool FileSource::skip(std::size_t size)
+	{
+		m_file.ignore(static_cast<std::streamsize>(size));
+		return static_cast<std::size_t>(m_file.gcount()) == size;
+	}
+
+
+	ReadAheadSource::ReadAheadSource(const std::string& filename, std::size_t bufferSize, std::size_t depth)
+		: m_file(filename, std::ios::binary)
+		, m_buffers(std::max<std::size_t>(1, depth))
+		, m_current(0)
+		, m_position(0)
+		, m_hasCurrent(false)
+		, m_filled(0)
+		, m_end(false)
+		, m_stop(false)
+		, m_open(m_file.is_open())
+	{
+		for (Buffer& buffer : m_buffers)
+			buffer.data.resize(std::max<std::size_t>(1, bufferSize));
+		if (m_open)
+			m_thread = std::thread(&ReadAheadSource::readLoop, this);
+		else
+			m_end = true;
+	}
+	ReadAheadSource::~ReadAheadSource()
+	{
+		if (m_thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_signal.notify_all();
+			m_thread.join();
+		}
+	}
+	bool ReadAheadSource::read(char* data, std::size_t size)
+	{
+		while (size > 0)
+		{
+			if (!m_hasCurrent || m_position == m_buffers[m_current].size)
+			{
+				if (!nextBuffer())
+					return false;
+				continue;
+			}
+			const std::size_t chunk = std::min(size, m_buffers[m_current].size - m_position);
+			std::memcpy(data, m_buffers[m_current].data.data() + m_position, chunk);
+			m_position += chunk;
+			data += chunk;
+			size -= chunk;
+		}
+		return true;
+	}
+	bool ReadAheadSource::skip(std::size_t size)
+	{
+		while (size > 0)
+		{
+			if (!m_hasCurrent || m_position == m_buffers[m_current].size)
+			{
+				if (!nextBuffer())
+					return false;
+				continue;
+			}
+			const std::size_t chunk = std::min(size, m_buffers[m_current].size - m_position);
+			m_position += chunk;
+			size -= chunk;
+		}
+		return true;
+	}
+	bool ReadAheadSource::nextBuffer()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_hasCurrent)
+		{
+			// Hands the consumed buffer back to the reader
+			m_current = (m_current + 1) % m_buffers.size();
+			--m_filled;
+			m_hasCurrent = false;
+			m_signal.notify_all();
+		}
+		m_signal.wait(lock, [this]() { return m_filled > 0 || m_end; });
+		if (m_filled == 0)
+			return false;
+		m_hasCurrent = true;
+		m_position = 0;
+		return true;
+	}
+	void ReadAheadSource::readLoop()
+	{
+		std::size_t next = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_signal.wait(lock, [this]() { return m_filled < m_buffers.size() || m_stop; });
+			if (m_stop)
+				break;
+			// The buffer is not visible to the consumer until it is counted as filled
+			Buffer& buffer = m_buffers[next];
+			lock.unlock();
+			m_file.read(buffer.data.data(), static_cast<std::streamsize>(buffer.data.size()));
+			buffer.size = static_cast<std::size_t>(m_file.gcount());
+			const bool end = !m_file;
+			lock.lock();
+			if (buffer.size > 0)
+			{
+				++m_filled;
+				next = (next + 1) % m_buffers.size();
+			}
+			m_end = end;
+			m_signal.notify_all();
+			if (end)
+				break;
+		}
+	}
+}
@@ -0,0 +1,208 @@
+#include "FileFollower.h"
+#include "ISerializableID.h"
+#include "IDAllocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace ObjectSerializer
+{
+	FileFollower::FileFollower(const std::string& filename)
+		: FileFollower(filename, Serializer::Settings())
+	{
+
+	}
+	FileFollower::FileFollower(const std::string& filename, const Serializer::Settings& settings)
+		: m_filename(filename)
+		, m_settings(settings)
+		, m_offset(0)
+		, m_fileSize(0)
+		, m_fileTime(0)
+		, m_fileDevice(0)
+		, m_fileIndex(0)
+	{
+
+	}
+
+	bool FileFollower::poll(std::vector<ISerializable*>& objs)
+	{
+		std::error_code error;
+		const std::uint64_t fileSize = static_cast<std::uint64_t>(std::filesystem::file_size(m_filename, error));
+		const std::int64_t fileTime = error ? 0 : static_cast<std::int64_t>(std::filesystem::last_write_time(m_filename, error).time_since_epoch().count());
+		std::uint64_t fileDevice = 0;
+		std::uint64_t fileIndex = 0;
+		if (error || !getFileIdentity(m_filename, fileDevice, fileIndex))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + m_filename);
+#endif
+			return false;
+		}
+		// The file was saved again or compacted, into a new file or in place
+		if (fileSize < m_offset || fileDevice != m_fileDevice || fileIndex != m_fileIndex)
+			m_offset = 0;
+		m_fileSize = fileSize;
+		m_fileTime = fileTime;
+		m_fileDevice = fileDevice;
+		m_fileIndex = fileIndex;
+		if (fileSize == m_offset)
+			return true;
+
+		std::ifstream file(m_filename, std::ios::binary);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + m_filename);
+#endif
+			return false;
+		}
+
+		// Reads the new bytes in chunks, a record larger than a chunk makes the next one larger
+		bool success = true;
+		std::size_t nextFreeID = 0;
+		std::size_t chunkSize = s_readChunkSize;
+		while (success && m_offset < fileSize)
+		{
+			const std::size_t remaining = static_cast<std::size_t>(std::min<std::uint64_t>(fileSize - m_offset, SIZE_MAX));
+			m_buffer.resize(std::min(chunkSize, remaining));
+			file.clear();
+			file.seekg(static_cast<std::streamoff>(m_offset), std::ios::beg);
+			file.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+			const std::size_t size = static_cast<std::size_t>(file.gcount());
+
+			std::size_t consumed = 0;
+			success = readRecords(size, objs, consumed, nextFreeID);
+			m_offset += consumed;
+			if (consumed == 0)
+			{
+				// Only a part of the tail record is written yet
+				if (size == remaining || size < chunkSize)
+					break;
+				chunkSize *= 2;
+			}
+		}
+		m_buffer.clear();
+		IDAllocator::seed(nextFreeID);
+		return success;
+	}
+	bool FileFollower::waitForChange(std::chrono::milliseconds timeout, std::chrono::milliseconds interval) const
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!fileChanged())
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+				return false;
+			std::this_thread::sleep_for(interval);
+		}
+		return true;
+	}
+	void FileFollower::reset()
+	{
+		m_offset = 0;
+		m_fileSize = 0;
+		m_fileTime = 0;
+		m_fileDevice = 0;
+		m_fileIndex = 0;
+	}
+
+	bool FileFollower::fileChanged() const
+	{
+		std::error_code error;
+		const std::uint64_t fileSize = static_cast<std::uint64_t>(std::filesystem::file_size(m_filename, error));
+		if (error)
+			return false;
+		const std::int64_t fileTime = static_cast<std::int64_t>(std::filesystem::last_write_time(m_filename, error).time_since_epoch().count());
+		std::uint64_t fileDevice = 0;
+		std::uint64_t fileIndex = 0;
+		if (error || !getFileIdentity(m_filename, fileDevice, fileIndex))
+			return false;
+		return fileSize != m_fileSize || fileTime != m_fileTime || fileDevice != m_fileDevice || fileIndex != m_fileIndex;
+	}
+	bool FileFollower::getFileIdentity(const std::string& filename, std::uint64_t& device, std::uint64_t& index)
+	{
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(filename.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+									nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			return false;
+		BY_HANDLE_FILE_INFORMATION info;
+		const bool success = GetFileInformationByHandle(handle, &info) != 0;
+		CloseHandle(handle);
+		if (!success)
+			return false;
+		device = info.dwVolumeSerialNumber;
+		index = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+		struct stat info;
+		if (::stat(filename.c_str(), &info) != 0)
+			return false;
+		device = static_cast<std::uint64_t>(info.st_dev);
+		index = static_cast<std::uint64_t>(info.st_ino);
+#endif
+		return true;
+	}
+	bool FileFollower::readRecords(std::size_t size, std::vector<ISerializable*>& objs, std::size_t& consumed, std::size_t& nextFreeID) const
+	{
+		const auto& mataMap = Serializer::getObjectMetaData();
+		BufferSource source(std::span<const char>(m_buffer.data(), size));
+		consumed = 0;
+		Serializer::RecordHeader header;
+		while (Serializer::readRecordHeader(source, header, m_settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const Serializer::ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			Serializer::PayloadLayout layout;
+			const bool known = meta && Serializer::getPayloadLayout(*meta, m_settings, layout);
+			std::size_t payloadSize = header.payloadSize;
+			if (!m_settings.lengthFramedRecords)
+			{
+				const Serializer::ObjectMetaData* deadMeta = meta ? nullptr : Serializer::findTombstoneType(header.typeHash);
+				Serializer::PayloadLayout deadLayout;
+				if (known)
+					payloadSize = layout.size;
+				else if (deadMeta && Serializer::getPayloadLayout(*deadMeta, m_settings, deadLayout))
+					payloadSize = deadLayout.size;
+				else if (!meta && Serializer::findReferenceType(header.typeHash))
+					payloadSize = sizeof(std::uint64_t);
+				else
+				{
+					// The size of the record is unknown, the rest of the file can't be read
+					Serializer::typeWithHashNotRegistered(header.typeHash);
+					return false;
+				}
+			}
+			else if (!meta && !Serializer::findTombstoneType(header.typeHash) && !Serializer::findReferenceType(header.typeHash))
+			{
+				Serializer::typeWithHashNotRegistered(header.typeHash);
+			}
+			if (payloadSize > source.getRemaining())
+				break;
+
+			// Deleted records and references to duplicates are skipped
+			const char* payload = m_buffer.data() + source.getPosition();
+			source.skip(payloadSize);
+			consumed = source.getPosition();
+			if (!known || !Serializer::checkPayloadSize(header, *meta, layout, m_settings))
+				continue;
+			ISerializable* obj = meta->create();
+			Serializer::decodePayload(payload, obj, layout);
+			objs.push_back(obj);
+			if (const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj))
+			{
+				if (objWithID->getID() >= nextFreeID)
+					nextFreeID = objWithID->getID() + 1;
+			}
+		}
+		return true;
+	}
+}
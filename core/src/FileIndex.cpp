@@ -0,0 +1,292 @@
+#include "FileIndex.h"
+
+#include <algorithm>
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// "OSIDX01" in little endian
+		constexpr std::uint64_t s_fileIndexMagic = 0x003130584449534FULL;
+
+		struct StoredEntry
+		{
+			std::uint64_t id;
+			std::uint64_t typeHash;
+			std::uint64_t offset;
+		};
+
+		using OffsetMap = std::unordered_map<std::size_t, std::vector<std::uint64_t>>;
+		// Bytes left behind the read position, counts stored in the file must fit into them
+		std::uint64_t getRemaining(std::istream& stream)
+		{
+			const std::streampos position = stream.tellg();
+			stream.seekg(0, std::ios::end);
+			const std::streampos end = stream.tellg();
+			stream.seekg(position);
+			return position < 0 || end < position ? 0 : static_cast<std::uint64_t>(end - position);
+		}
+		void writeOffsets(std::ostream& stream, const OffsetMap& offsetMap)
+		{
+			std::uint64_t typeCount = offsetMap.size();
+			stream.write(reinterpret_cast<const char*>(&typeCount), sizeof(typeCount));
+			for (const auto& type : offsetMap)
+			{
+				std::uint64_t typeHash = type.first;
+				std::uint64_t offsetCount = type.second.size();
+				stream.write(reinterpret_cast<const char*>(&typeHash), sizeof(typeHash));
+				stream.write(reinterpret_cast<const char*>(&offsetCount), sizeof(offsetCount));
+				stream.write(reinterpret_cast<const char*>(type.second.data()), static_cast<std::streamsize>(type.second.size() * sizeof(std::uint64_t)));
+			}
+		}
+		bool readOffsets(std::istream& stream, OffsetMap& offsetMap)
+		{
+			std::uint64_t typeCount = 0;
+			stream.read(reinterpret_cast<char*>(&typeCount), sizeof(typeCount));
+			for (std::uint64_t i = 0; i < typeCount && stream; ++i)
+			{
+				std::uint64_t typeHash = 0;
+				std::uint64_t offsetCount = 0;
+				stream.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash));
+				stream.read(reinterpret_cast<char*>(&offsetCount), sizeof(offsetCount));
+				if (!stream)
+					break;
+				if (offsetCount > getRemaining(stream) / sizeof(std::uint64_t))
+					return false;
+				std::vector<std::uint64_t>& offsets = offsetMap[static_cast<std::size_t>(typeHash)];
+				offsets.resize(static_cast<std::size_t>(offsetCount));
+				stream.read(reinterpret_cast<char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(std::uint64_t)));
+			}
+			return static_cast<bool>(stream);
+		}
+	}
+
+	FileIndex::FileIndex()
+	{
+
+	}
+
+	bool FileIndex::build(const std::string& filename, const Serializer::Settings& settings)
+	{
+		clear();
+		FileSource source(filename);
+		if (!source.isOpen())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+
+		const auto& mataMap = Serializer::getObjectMetaData();
+		const std::size_t headerSize = Serializer::getRecordHeaderSize(settings);
+		std::uint64_t offset = 0;
+		Serializer::RecordHeader header;
+		while (Serializer::readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const Serializer::ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			Serializer::PayloadLayout layout;
+			if (!meta)
+			{
+				// Deleted records become free slots of their type
+				const Serializer::ObjectMetaData* deadMeta = Serializer::findTombstoneType(header.typeHash);
+				if (deadMeta && Serializer::getPayloadLayout(*deadMeta, settings, layout) &&
+					Serializer::checkPayloadSize(header, *deadMeta, layout, settings))
+				{
+					m_freeOffsets[deadMeta->typeHash].push_back(offset);
+					if (!source.skip(layout.size))
+						break;
+					offset += headerSize + layout.size;
+					continue;
+				}
+			}
+			if (!meta || !Serializer::getPayloadLayout(*meta, settings, layout) ||
+				!Serializer::checkPayloadSize(header, *meta, layout, settings))
+			{
+				if (!settings.lengthFramedRecords && !meta && Serializer::findReferenceType(header.typeHash))
+				{
+					// References to duplicate payloads are not indexed
+					if (!source.skip(sizeof(std::uint64_t)))
+						break;
+					offset += headerSize + sizeof(std::uint64_t);
+					continue;
+				}
+				if (!settings.lengthFramedRecords)
+				{
+					// The size of the record is unknown, the rest of the file can't be indexed
+					Serializer::typeWithHashNotRegistered(header.typeHash);
+					return false;
+				}
+				source.skip(header.payloadSize);
+				offset += headerSize + header.payloadSize;
+				continue;
+			}
+
+			addOffset(header.typeHash, offset);
+			if (meta->idOffset == Serializer::s_noID)
+			{
+				if (!source.skip(layout.size))
+					break;
+			}
+			else
+			{
+				char* payload = Serializer::getScratchBuffer(layout.size);
+				if (!source.read(payload, layout.size))
+					break;
+				std::size_t id;
+				if (Serializer::readID(payload, *meta, layout, id))
+					m_entries[id] = Entry{ header.typeHash, offset };
+			}
+			offset += headerSize + layout.size;
+		}
+		return true;
+	}
+
+	bool FileIndex::saveToFile(const std::string& indexFilename) const
+	{
+		std::ofstream file(indexFilename, std::ios::binary);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + indexFilename);
+#endif
+			return false;
+		}
+
+		std::vector<StoredEntry> entries;
+		entries.reserve(m_entries.size());
+		for (const auto& entry : m_entries)
+			entries.push_back({ entry.first, entry.second.typeHash, entry.second.offset });
+		std::uint64_t entryCount = entries.size();
+		file.write(reinterpret_cast<const char*>(&s_fileIndexMagic), sizeof(s_fileIndexMagic));
+		file.write(reinterpret_cast<const char*>(&entryCount), sizeof(entryCount));
+		file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(StoredEntry)));
+		writeOffsets(file, m_typeOffsets);
+		writeOffsets(file, m_freeOffsets);
+		return file.good();
+	}
+	bool FileIndex::loadFromFile(const std::string& indexFilename)
+	{
+		clear();
+		std::ifstream file(indexFilename, std::ios::binary);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + indexFilename);
+#endif
+			return false;
+		}
+
+		std::uint64_t magic = 0;
+		std::uint64_t entryCount = 0;
+		file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+		file.read(reinterpret_cast<char*>(&entryCount), sizeof(entryCount));
+		if (!file || magic != s_fileIndexMagic || entryCount > getRemaining(file) / sizeof(StoredEntry))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("File is not an index: " + indexFilename);
+#endif
+			return false;
+		}
+		std::vector<StoredEntry> entries(static_cast<std::size_t>(entryCount));
+		file.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(StoredEntry)));
+		for (const StoredEntry& entry : entries)
+			m_entries[static_cast<std::size_t>(entry.id)] = Entry{ static_cast<std::size_t>(entry.typeHash), entry.offset };
+
+		if (!file || !readOffsets(file, m_typeOffsets) || !readOffsets(file, m_freeOffsets))
+		{
+			clear();
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Index file is truncated: " + indexFilename);
+#endif
+			return false;
+		}
+		return true;
+	}
+
+	bool FileIndex::find(std::size_t objectID, Entry& entry) const
+	{
+		const auto& it = m_entries.find(objectID);
+		if (it == m_entries.end())
+			return false;
+		entry = it->second;
+		return true;
+	}
+	void FileIndex::insert(std::size_t objectID, const Entry& entry)
+	{
+		const auto& it = m_entries.find(objectID);
+		if (it != m_entries.end())
+		{
+			removeOffset(it->second.typeHash, it->second.offset);
+			it->second = entry;
+		}
+		else
+			m_entries[objectID] = entry;
+		addOffset(entry.typeHash, entry.offset);
+	}
+	bool FileIndex::remove(std::size_t objectID)
+	{
+		const auto& it = m_entries.find(objectID);
+		if (it == m_entries.end())
+			return false;
+		removeOffset(it->second.typeHash, it->second.offset);
+		m_freeOffsets[it->second.typeHash].push_back(it->second.offset);
+		m_entries.erase(it);
+		return true;
+	}
+	void FileIndex::clear()
+	{
+		m_entries.clear();
+		m_typeOffsets.clear();
+		m_freeOffsets.clear();
+	}
+
+	std::span<const std::uint64_t> FileIndex::getOffsets(std::size_t typeHash) const
+	{
+		const auto& it = m_typeOffsets.find(typeHash);
+		if (it == m_typeOffsets.end())
+			return {};
+		return it->second;
+	}
+
+	std::span<const std::uint64_t> FileIndex::getFreeOffsets(std::size_t typeHash) const
+	{
+		const auto& it = m_freeOffsets.find(typeHash);
+		if (it == m_freeOffsets.end())
+			return {};
+		return it->second;
+	}
+	bool FileIndex::takeFreeOffset(std::size_t typeHash, std::uint64_t& offset)
+	{
+		const auto& it = m_freeOffsets.find(typeHash);
+		if (it == m_freeOffsets.end() || it->second.empty())
+			return false;
+		offset = it->second.back();
+		it->second.pop_back();
+		return true;
+	}
+
+	void FileIndex::addOffset(std::size_t typeHash, std::uint64_t offset)
+	{
+		std::vector<std::uint64_t>& offsets = m_typeOffsets[typeHash];
+		// Records get added in file order, keep the list sorted otherwise
+		if (offsets.empty() || offsets.back() < offset)
+			offsets.push_back(offset);
+		else
+		{
+			auto pos = std::lower_bound(offsets.begin(), offsets.end(), offset);
+			if (pos == offsets.end() || *pos != offset)
+				offsets.insert(pos, offset);
+		}
+	}
+	void FileIndex::removeOffset(std::size_t typeHash, std::uint64_t offset)
+	{
+		const auto& it = m_typeOffsets.find(typeHash);
+		if (it == m_typeOffsets.end())
+			return;
+		auto pos = std::lower_bound(it->second.begin(), it->second.end(), offset);
+		if (pos != it->second.end() && *pos == offset)
+			it->second.erase(pos);
+	}
+}
@@ -0,0 +1,63 @@
+#include "IDAllocator.h"
+
+namespace ObjectSerializer
+{
+	std::atomic<std::size_t> IDAllocator::s_nextID{ 0 };
+	std::atomic<std::size_t> IDAllocator::s_minID{ 0 };
+	std::atomic<std::size_t> IDAllocator::s_blockSize{ 64 };
+
+	namespace
+	{
+		struct IDBlock
+		{
+			std::size_t next = 0;
+			std::size_t end = 0;
+		};
+		thread_local IDBlock t_block;
+	}
+
+	std::size_t IDAllocator::allocate()
+	{
+		IDBlock& block = t_block;
+		// Blocks reserved before a seed() may start below the seeded ID
+		if (block.next == block.end || block.next < s_minID.load(std::memory_order_acquire))
+		{
+			const std::size_t blockSize = s_blockSize.load(std::memory_order_relaxed);
+			block.next = s_nextID.fetch_add(blockSize, std::memory_order_relaxed);
+			block.end = block.next + blockSize;
+		}
+		return block.next++;
+	}
+
+	void IDAllocator::seed(std::size_t minNextID)
+	{
+		std::size_t current = s_nextID.load(std::memory_order_relaxed);
+		while (current < minNextID &&
+			   !s_nextID.compare_exchange_weak(current, minNextID, std::memory_order_relaxed))
+		{
+		}
+		// Only blocks which start below minNextID get discarded, seeding with
+		// an ID that was already handed out leaves all blocks in use
+		std::size_t minID = s_minID.load(std::memory_order_relaxed);
+		while (minID < minNextID &&
+			   !s_minID.compare_exchange_weak(minID, minNextID, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	std::size_t IDAllocator::getNextFreeID()
+	{
+		return s_nextID.load(std::memory_order_relaxed);
+	}
+
+	void IDAllocator::setBlockSize(std::size_t size)
+	{
+		if (size == 0)
+			size = 1;
+		s_blockSize.store(size, std::memory_order_relaxed);
+	}
+	std::size_t IDAllocator::getBlockSize()
+	{
+		return s_blockSize.load(std::memory_order_relaxed);
+	}
+}
@@ -1,4 +1,5 @@
 #include "ISerializableID.h"
+#include "IDAllocator.h"
 
 namespace ObjectSerializer
 {
@@ -9,7 +10,6 @@ namespace ObjectSerializer
 	}
 	std::size_t ISerializableID::getNextID()
 	{
-		static std::size_t id = 0;
-		return id++;
+		return IDAllocator::allocate();
 	}
 }
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "Journal.h"
+#include "FileIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <typeindex>
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// Journal entry: [recordSize][checksum][record]
+		constexpr std::size_t s_entryHeaderSize = 2 * sizeof(std::uint64_t);
+
+		// FNV-1a, detects entries which were torn by a crash
+		std::uint64_t checksum(const char* data, std::size_t size)
+		{
+			std::uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				hash ^= static_cast<unsigned char>(data[i]);
+				hash *= 0x100000001b3ULL;
+			}
+			return hash;
+		}
+	}
+
+	Journal::Journal(const std::string& dataFilename)
+		: Journal(dataFilename, Serializer::Settings(), Settings())
+	{
+
+	}
+	Journal::Journal(const std::string& dataFilename, const Serializer::Settings& settings, const Settings& journalSettings)
+		: m_dataFilename(dataFilename)
+		, m_journalFilename(dataFilename + ".wal")
+		, m_settings(settings)
+		, m_journalSettings(journalSettings)
+		, m_enqueued(0)
+		, m_durable(0)
+		, m_journalSize(0)
+		, m_running(false)
+		, m_failed(false)
+		, m_checkpointing(false)
+	{
+
+	}
+	Journal::~Journal()
+	{
+		close();
+	}
+
+	bool Journal::open()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running)
+			return true;
+		if (!recover())
+			return false;
+
+		m_journal = std::make_unique<SyncFileSink>(m_journalFilename, SyncFileSink::Mode::Truncate);
+		if (!m_journal->isOpen() || !m_journal->sync())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open journal: " + m_journalFilename);
+#endif
+			m_journal.reset();
+			return false;
+		}
+		m_journalSize = 0;
+		m_failed = false;
+		m_running = true;
+		m_commitThread = std::thread(&Journal::commitLoop, this);
+		return true;
+	}
+	bool Journal::close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_running)
+				return true;
+		}
+		bool success = checkpoint();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_running = false;
+		}
+		// The commit thread writes the remaining batch before it stops
+		m_commitSignal.notify_one();
+		m_commitThread.join();
+		m_journal.reset();
+		return success;
+	}
+	bool Journal::isOpen() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_running;
+	}
+
+	bool Journal::overrideInFile(const ISerializableID* obj)
+	{
+		if (!obj)
+			return false;
+		const auto& mataMap = Serializer::getObjectMetaData();
+		const std::size_t typeHash = std::type_index(typeid(*obj)).hash_code();
+		const auto& it = mataMap.find(typeHash);
+		if (it == mataMap.end())
+		{
+			Serializer::typeNotRegistered(obj);
+			return false;
+		}
+		Serializer::PayloadLayout layout;
+		if (!Serializer::getPayloadLayout(it->second, m_settings, layout))
+			return false;
+
+		// Only the record, a sorted file's sparse index is not part of the update
+		std::vector<char> entry(s_entryHeaderSize);
+		BufferSink sink(entry);
+		const ISerializable* record = obj;
+		if (!Serializer::writeRecords(sink, &record, 1, typeHash, layout, m_settings))
+			return false;
+		const std::uint64_t recordSize = entry.size() - s_entryHeaderSize;
+		const std::uint64_t recordChecksum = checksum(entry.data() + s_entryHeaderSize, static_cast<std::size_t>(recordSize));
+		std::memcpy(entry.data(), &recordSize, sizeof(recordSize));
+		std::memcpy(entry.data() + sizeof(recordSize), &recordChecksum, sizeof(recordChecksum));
+
+		bool startCheckpoint = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_durableSignal.wait(lock, [this]() { return !m_checkpointing || !m_running; });
+			if (!m_running || m_failed)
+				return false;
+
+			m_batch.insert(m_batch.end(), entry.begin(), entry.end());
+			const std::uint64_t sequence = ++m_enqueued;
+			m_pending[obj->getID()].assign(entry.begin() + s_entryHeaderSize, entry.end());
+			m_commitSignal.notify_one();
+
+			m_durableSignal.wait(lock, [this, sequence]() { return m_durable >= sequence || m_failed; });
+			if (m_durable < sequence)
+				return false;
+			startCheckpoint = m_journalSettings.checkpointBytes && !m_checkpointing &&
+							  m_journalSize >= m_journalSettings.checkpointBytes;
+		}
+		if (startCheckpoint)
+			checkpoint();
+		return true;
+	}
+	bool Journal::loadFromFile(std::size_t objectID, ISerializableID*& obj) const
+	{
+		obj = nullptr;
+		std::vector<char> record;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const auto& it = m_pending.find(objectID);
+			if (it != m_pending.end())
+				record = it->second;
+		}
+		if (record.empty())
+			return Serializer::loadFromFile(m_dataFilename, objectID, obj, m_settings);
+
+		std::vector<ISerializable*> objs;
+		BufferSource source(record);
+		if (!Serializer::loadFrom(source, objs, m_settings) || objs.empty())
+			return false;
+		obj = dynamic_cast<ISerializableID*>(objs[0]);
+		return obj != nullptr;
+	}
+
+	bool Journal::checkpoint()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_running)
+			return false;
+		// New updates wait until the checkpoint is done
+		m_durableSignal.wait(lock, [this]() { return !m_checkpointing; });
+		m_checkpointing = true;
+		m_commitSignal.notify_one();
+		m_durableSignal.wait(lock, [this]() { return m_durable == m_enqueued || m_failed; });
+
+		bool success = !m_failed;
+		if (success && !m_pending.empty())
+		{
+			// m_pending does not change while checkpointing, it can be read without the lock
+			lock.unlock();
+			success = applyPending(m_pending);
+			lock.lock();
+			if (success)
+			{
+				m_pending.clear();
+				m_journal = std::make_unique<SyncFileSink>(m_journalFilename, SyncFileSink::Mode::Truncate);
+				success = m_journal->isOpen() && m_journal->sync();
+				m_journalSize = 0;
+				m_failed = !success;
+			}
+		}
+		m_checkpointing = false;
+		m_durableSignal.notify_all();
+		return success;
+	}
+
+	std::size_t Journal::getPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pending.size();
+	}
+
+	void Journal::commitLoop()
+	{
+		std::vector<char> batch;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_commitSignal.wait(lock, [this]() { return !m_batch.empty() || !m_running; });
+			if (m_batch.empty())
+				break;
+
+			// Give other threads the chance to add their updates to the same sync
+			m_commitSignal.wait_for(lock, m_journalSettings.commitDelay, [this]()
+				{
+					return m_batch.size() >= m_journalSettings.commitBytes || m_checkpointing || !m_running;
+				});
+			batch.swap(m_batch);
+			const std::uint64_t last = m_enqueued;
+			lock.unlock();
+			bool success = m_journal->write(batch.data(), batch.size()) && m_journal->sync();
+			lock.lock();
+			if (success)
+			{
+				m_durable = last;
+				m_journalSize += batch.size();
+			}
+			else
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to write journal: " + m_journalFilename);
+#endif
+				m_failed = true;
+			}
+			batch.clear();
+			m_durableSignal.notify_all();
+		}
+	}
+	bool Journal::applyPending(const std::unordered_map<std::size_t, std::vector<char>>& pending)
+	{
+		// The offsets of the index must stay valid until the writes are done
+		std::lock_guard<std::mutex> lock(Serializer::getFileMutex(m_dataFilename));
+		FileIndex index;
+		if (!index.build(m_dataFilename, m_settings))
+			return false;
+		SyncFileSink data(m_dataFilename, SyncFileSink::Mode::Update);
+		if (!data.isOpen())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to open file: " + m_dataFilename);
+#endif
+			return false;
+		}
+
+		// Write in file order
+		std::vector<std::pair<std::uint64_t, const std::vector<char>*>> writes;
+		writes.reserve(pending.size());
+		for (const auto& update : pending)
+		{
+			FileIndex::Entry entry;
+			std::size_t typeHash = 0;
+			std::memcpy(&typeHash, update.second.data(), std::min(sizeof(typeHash), update.second.size()));
+			if (!index.find(update.first, entry) || entry.typeHash != typeHash)
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Object with ID: " + std::to_string(update.first) + " is not in file: " + m_dataFilename + ". Update dropped");
+#endif
+				continue;
+			}
+			writes.push_back({ entry.offset, &update.second });
+		}
+		std::sort(writes.begin(), writes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		std::ifstream stored(m_dataFilename, std::ios::binary);
+		std::vector<char> record;
+		for (const auto& write : writes)
+		{
+			// The journal record holds no pointer targets, the ones in the file stay.
+			// A record of another size than the stored one is rejected.
+			record = *write.second;
+			if (!Serializer::keepStoredPointers(stored, write.first, record.data(), record.size(), m_settings) ||
+				!data.seek(write.first) || !data.write(record.data(), record.size()))
+				return false;
+		}
+		return data.sync();
+	}
+	bool Journal::recover()
+	{
+		std::ifstream file(m_journalFilename, std::ios::binary);
+		if (!file.is_open())
+			return true;
+		std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		file.close();
+
+		// Everything behind the first incomplete entry was not acknowledged
+		std::size_t position = 0;
+		while (content.size() - position >= s_entryHeaderSize)
+		{
+			std::uint64_t recordSize;
+			std::uint64_t recordChecksum;
+			std::memcpy(&recordSize, content.data() + position, sizeof(recordSize));
+			std::memcpy(&recordChecksum, content.data() + position + sizeof(recordSize), sizeof(recordChecksum));
+			const char* record = content.data() + position + s_entryHeaderSize;
+			if (recordSize > content.size() - position - s_entryHeaderSize ||
+				checksum(record, static_cast<std::size_t>(recordSize)) != recordChecksum)
+				break;
+
+			std::vector<ISerializable*> objs;
+			BufferSource source(std::span<const char>(record, static_cast<std::size_t>(recordSize)));
+			Serializer::loadFrom(source, objs, m_settings);
+			for (ISerializable* obj : objs)
+			{
+				if (const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj))
+					m_pending[objWithID->getID()].assign(record, record + recordSize);
+				delete obj;
+			}
+			position += s_entryHeaderSize + static_cast<std::size_t>(recordSize);
+		}
+		if (m_pending.empty())
+			return true;
+		if (!applyPending(m_pending))
+			return false;
+		m_pending.clear();
+		return true;
+	}
+}
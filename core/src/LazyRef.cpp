@@ -0,0 +1,43 @@
+#include "LazyRef.h"
+
+namespace ObjectSerializer
+{
+	LazyFile::LazyFile(const std::string& filename)
+		: LazyFile(filename, Serializer::Settings())
+	{
+
+	}
+	LazyFile::LazyFile(const std::string& filename, const Serializer::Settings& settings)
+		: m_filename(filename)
+		, m_settings(settings)
+		, m_indexed(false)
+	{
+
+	}
+
+	bool LazyFile::open()
+	{
+		m_indexed = m_index.build(m_filename, m_settings);
+		return m_indexed;
+	}
+
+	bool LazyFile::load(std::size_t objectID, ISerializableID*& obj) const
+	{
+		obj = nullptr;
+		if (!m_indexed)
+			return Serializer::loadFromFile(m_filename, objectID, obj, m_settings);
+
+		std::vector<ISerializableID*> objs;
+		const std::size_t ids[] = { objectID };
+		if (!Serializer::loadFromFile(m_filename, m_index, ids, objs, m_settings))
+			return false;
+		obj = objs[0];
+		return obj != nullptr;
+	}
+	bool LazyFile::load(std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const
+	{
+		if (!m_indexed)
+			return Serializer::loadFromFile(m_filename, objectIDs, objs, m_settings);
+		return Serializer::loadFromFile(m_filename, m_index, objectIDs, objs, m_settings);
+	}
+}
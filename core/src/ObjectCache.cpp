@@ -0,0 +1,153 @@
+#include "ObjectCache.h"
+
+namespace ObjectSerializer
+{
+	ObjectCache::ObjectCache(std::size_t memoryBudget)
+		: ObjectCache(memoryBudget, Serializer::Settings())
+	{
+
+	}
+	ObjectCache::ObjectCache(std::size_t memoryBudget, const Serializer::Settings& settings)
+		: m_settings(settings)
+		, m_memoryBudget(memoryBudget)
+		, m_memoryUsage(0)
+		, m_hits(0)
+		, m_misses(0)
+	{
+
+	}
+	ObjectCache::~ObjectCache()
+	{
+
+	}
+
+	std::shared_ptr<const ISerializableID> ObjectCache::get(const std::string& filename, std::size_t objectID)
+	{
+		Key key{ filename, objectID };
+		std::size_t generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const auto& it = m_index.find(key);
+			if (it != m_index.end())
+			{
+				++m_hits;
+				m_entries.splice(m_entries.begin(), m_entries, it->second);
+				return it->second->object;
+			}
+			++m_misses;
+			generation = getGeneration(filename);
+		}
+
+		// Load without holding the lock so that hits of other threads are not blocked
+		ISerializableID* obj = nullptr;
+		if (!Serializer::loadFromFile(filename, objectID, obj, m_settings) || !obj)
+			return nullptr;
+		std::shared_ptr<const ISerializableID> object(obj);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (getGeneration(filename) == generation)
+			insert(key, object);
+		return object;
+	}
+
+	bool ObjectCache::overrideInFile(const std::string& filename, const ISerializableID* obj)
+	{
+		if (!obj)
+			return false;
+		// Write without holding the lock, loads running meanwhile are not cached
+		bool success = Serializer::overrideInFile(filename, obj, m_settings);
+		invalidate(filename, obj->getID());
+		return success;
+	}
+
+	void ObjectCache::invalidate(const std::string& filename, std::size_t objectID)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		bumpGeneration(filename);
+		const auto& it = m_index.find(Key{ filename, objectID });
+		if (it != m_index.end())
+			erase(it->second);
+	}
+	void ObjectCache::invalidate(const std::string& filename)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		bumpGeneration(filename);
+		for (auto it = m_entries.begin(); it != m_entries.end();)
+		{
+			auto next = std::next(it);
+			if (it->key.filename == filename)
+				erase(it);
+			it = next;
+		}
+	}
+	void ObjectCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_index.clear();
+		m_entries.clear();
+		m_memoryUsage = 0;
+	}
+
+	void ObjectCache::setMemoryBudget(std::size_t memoryBudget)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_memoryBudget = memoryBudget;
+		evict();
+	}
+	std::size_t ObjectCache::getMemoryBudget() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_memoryBudget;
+	}
+	std::size_t ObjectCache::getMemoryUsage() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_memoryUsage;
+	}
+	std::size_t ObjectCache::getHitCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_hits;
+	}
+	std::size_t ObjectCache::getMissCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_misses;
+	}
+
+	void ObjectCache::insert(const Key& key, const std::shared_ptr<const ISerializableID>& object)
+	{
+		// Another thread may have loaded the same object in the meantime
+		const auto& it = m_index.find(key);
+		if (it != m_index.end())
+			erase(it->second);
+
+		std::size_t size = Serializer::getObjectSize(object.get());
+		if (size > m_memoryBudget)
+			return;
+		m_entries.push_front(Entry{ key, object, size });
+		m_index[key] = m_entries.begin();
+		m_memoryUsage += size;
+		evict();
+	}
+	std::size_t ObjectCache::getGeneration(const std::string& filename) const
+	{
+		const auto& it = m_generations.find(filename);
+		return it != m_generations.end() ? it->second : 0;
+	}
+	void ObjectCache::bumpGeneration(const std::string& filename)
+	{
+		++m_generations[filename];
+	}
+	void ObjectCache::erase(EntryList::iterator it)
+	{
+		m_memoryUsage -= it->size;
+		m_index.erase(it->key);
+		m_entries.erase(it);
+	}
+	void ObjectCache::evict()
+	{
+		while (m_memoryUsage > m_memoryBudget && !m_entries.empty())
+			erase(std::prev(m_entries.end()));
+	}
+}
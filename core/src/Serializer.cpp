@@ -2,6 +2,23 @@
 
 #include "ISerializable.h"
 #include "ISerializableID.h"
+#include "IDAllocator.h"
+#include "FileIndex.h"
+#include "BloomFilter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace ObjectSerializer
 {
@@ -15,140 +32,357 @@ namespace ObjectSerializer
 	Serializer::Serializer()
 	{
 
+	}
+	Serializer::Serializer(const Settings& settings)
+		: m_settings(settings)
+	{
+
 	}
 	Serializer::~Serializer()
 	{
 
 	}
+	const Serializer::Settings& Serializer::getDefaultSettings()
+	{
+		static const Settings settings;
+		return settings;
+	}
 
 	bool Serializer::saveToFile(const std::string& filename) const
 	{
-		return saveToFile(filename, m_objs);
+		return saveToFile(filename, m_objs, m_settings);
+	}
+	std::future<bool> Serializer::checkpointToFile(const std::string& filename) const
+	{
+		return checkpointToFile(filename, m_objs, m_settings);
 	}
 	bool Serializer::loadFromFile(const std::string& filename)
 	{
-		return loadFromFile(filename, m_objs);
+		return loadFromFile(filename, m_objs, m_settings);
+	}
+	bool Serializer::saveTo(IDataSink& sink) const
+	{
+		return saveTo(sink, m_objs, m_settings);
+	}
+	bool Serializer::loadFrom(IDataSource& source)
+	{
+		return loadFrom(source, m_objs, m_settings);
+	}
+	bool Serializer::loadFromFile(const std::string& filename, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const
+	{
+		return loadFromFile(filename, objectIDs, objs, m_settings);
+	}
+	bool Serializer::loadFromFile(const std::string& filename, const FileIndex& index, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const
+	{
+		return loadFromFile(filename, index, objectIDs, objs, m_settings);
+	}
+	bool Serializer::loadFromFile(const std::string& filename, const BloomFilter& filter, std::size_t objectID, ISerializableID*& obj) const
+	{
+		return loadFromFile(filename, filter, objectID, obj, m_settings);
+	}
+	bool Serializer::loadFromFile(const std::string& filename, const BloomFilter& filter, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const
+	{
+		return loadFromFile(filename, filter, objectIDs, objs, m_settings);
+	}
+	bool Serializer::loadRange(const std::string& filename, std::size_t lowID, std::size_t highID, std::vector<ISerializableID*>& objs) const
+	{
+		return loadRange(filename, lowID, highID, objs, m_settings);
+	}
+	bool Serializer::removeFromFile(const std::string& filename, std::size_t objectID) const
+	{
+		return removeFromFile(filename, objectID, m_settings);
+	}
+	bool Serializer::removeFromFile(const std::string& filename, FileIndex& index, std::size_t objectID) const
+	{
+		return removeFromFile(filename, index, objectID, m_settings);
+	}
+	bool Serializer::addToFile(const std::string& filename, const ISerializableID* obj) const
+	{
+		return addToFile(filename, obj, m_settings);
+	}
+	bool Serializer::addToFile(const std::string& filename, FileIndex& index, const ISerializableID* obj) const
+	{
+		return addToFile(filename, index, obj, m_settings);
+	}
+	bool Serializer::compactFile(const std::string& filename) const
+	{
+		return compactFile(filename, m_settings);
+	}
+	std::future<bool> Serializer::compactFileAsync(const std::string& filename) const
+	{
+		return compactFileAsync(filename, m_settings);
+	}
+
+	bool Serializer::saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs, const Settings& settings)
+	{
+		return writeFile(filename, [&objs, &settings](IDataSink& file)
+			{
+				// Encoding continues while the previous buffer gets written
+				BackgroundSink sink(file);
+				return saveTo(sink, objs, settings) && sink.flush();
+			}, settings);
+	}
+	std::future<bool> Serializer::checkpointToFile(const std::string& filename, const std::vector<ISerializable*>& objs, const Settings& settings)
+	{
+		std::vector<std::vector<char>> chunks;
+		if (!stageRecords(objs, settings, chunks))
+		{
+			std::promise<bool> failed;
+			failed.set_value(false);
+			return failed.get_future();
+		}
+		return std::async(std::launch::async, [filename, settings, chunks = std::move(chunks)]()
+			{
+				return writeFile(filename, [&chunks](IDataSink& file)
+					{
+						for (const std::vector<char>& chunk : chunks)
+						{
+							if (!file.write(chunk.data(), chunk.size()))
+								return false;
+						}
+						return true;
+					}, settings);
+			});
+	}
+	bool Serializer::loadFromFile(const std::string& filename, std::vector<ISerializable*>& objs, const Settings& settings)
+	{
+		const auto load = [&](auto& source)
+			{
+				if (!source.isOpen())
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					getLogger().logError("Failed to open file: " + filename);
+#endif
+					return false;
+				}
+				return loadFrom(source, objs, settings);
+			};
+		// Files which fit into one buffer are not worth the reader thread and its buffers
+		std::error_code error;
+		if (std::filesystem::file_size(filename, error) <= s_readAheadBufferSize && !error)
+		{
+			FileSource source(filename);
+			return load(source);
+		}
+		// The file is read ahead while the objects get created
+		ReadAheadSource source(filename, s_readAheadBufferSize);
+		return load(source);
 	}
 
-	bool Serializer::saveToFile(const std::string& filename, const std::vector<ISerializable*>& objs)
+	bool Serializer::saveTo(IDataSink& sink, const std::vector<ISerializable*>& objs, const Settings& settings)
 	{
 #if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
 		Log::LogObject& logger = getLogger();
 #endif
+		std::vector<ISerializable*> sorted;
+		if (settings.sparseIndexInterval != 0)
+			sortByID(objs, sorted);
+		const std::vector<ISerializable*>& ordered = settings.sparseIndexInterval != 0 ? sorted : objs;
+
 		const auto& mataMap = getObjectMetaData();
-		const VTableMetaData& vTableMetaData = getVTableMetaData();
-		std::ofstream outFile(filename, std::ios::binary);
-		if (!outFile.is_open())
+		WriteContext context;
+		context.sparseIndexInterval = settings.sparseIndexInterval;
+		context.deduplicate = settings.deduplicatePayloads;
+		// Pointer members store the record position of their target
+		context.hasPointers = hasPointerMembers(ordered);
+		if (context.hasPointers)
 		{
-#if LOGGER_LIBRARY_AVAILABLE == 1
-			getLogger().logError("Failed to open file: " + filename);
-#endif
-			return false;
+			context.pointerTable.reserve(ordered.size());
+			std::uintptr_t position = 0;
+			for (const ISerializable* obj : ordered)
+			{
+				if (isTypeRegistered(std::type_index(typeid(*obj)).hash_code()))
+					context.pointerTable.emplace(obj, ++position);
+			}
 		}
-		for (const auto& obj : objs)
+		std::size_t index = 0;
+		while (index < ordered.size())
 		{
+			const ISerializable* obj = ordered[index];
 			std::size_t typeHash = std::type_index(typeid(*obj)).hash_code();
+
+			// Consecutive objects of the same type are written as one run
+			std::size_t runEnd = index + 1;
+			while (runEnd < ordered.size() && std::type_index(typeid(*ordered[runEnd])).hash_code() == typeHash)
+				++runEnd;
+
 			const auto& it = mataMap.find(typeHash);
 			if (it != mataMap.end())
 			{
 				const ObjectMetaData& meta = it->second;
 
-				outFile.write(reinterpret_cast<const char*>(&typeHash), sizeof(typeHash));
-				size_t byteCount = meta.size;
-				const char* startData = reinterpret_cast<const char*>(obj);
-
-				if (!vTableMetaData.serializeVtable)
+				PayloadLayout layout;
+				if (getPayloadLayout(meta, settings, layout))
 				{
-					if (meta.size < vTableMetaData.size)
+#if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
+					logger.logInfo("Serializing " + std::to_string(runEnd - index) + " objects of type: " + meta.name + " [" + std::to_string(layout.size) + " bytes each]");
+#endif
+					if (!writeRecords(sink, ordered.data() + index, runEnd - index, typeHash, layout, settings, &context))
 					{
 #if LOGGER_LIBRARY_AVAILABLE == 1
-						getLogger().logError("Object size is less than vtable size. Type: " + meta.name);
+						getLogger().logError("Failed to write object of type: " + meta.name);
 #endif
-						continue;
-					}
-					byteCount -= vTableMetaData.size;
-					if (vTableMetaData.location == VTableMetaData::Location::Beginning)
-					{
-						startData += vTableMetaData.size;
+						return false;
 					}
 				}
-#if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
-				logger.logInfo("Serializing object of type: " + meta.name + " [" + std::to_string(byteCount) + " bytes]");
-#endif
-				outFile.write(startData, byteCount);
 			}
 			else
 			{
 				typeNotRegistered(obj);
 			}
+			index = runEnd;
 		}
-		outFile.close();
+		if (settings.sparseIndexInterval != 0)
+			return writeSparseIndex(sink, context.sparseIndex, context.offset);
 		return true;
 	}
-	bool Serializer::loadFromFile(const std::string& filename, std::vector<ISerializable*>& objs)
+	bool Serializer::loadFrom(IDataSource& source, std::vector<ISerializable*>& objs, const Settings& settings)
 	{
 #if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
 		Log::LogObject& logger = getLogger();
 #endif
-		std::ifstream inFile(filename, std::ios::binary);
-		if (!inFile.is_open())
-		{
-#if LOGGER_LIBRARY_AVAILABLE == 1
-			getLogger().logError("Failed to open file: " + filename);
-#endif
-			return false;
-		}
 		objs.clear();
-		const VTableMetaData& vTableMetaData = getVTableMetaData();
 		const auto& mataMap = getObjectMetaData();
+		std::size_t nextFreeID = 0;
 
-		while (inFile)
+		// Pointer members and references to duplicate payloads get resolved by record position.
+		// records holds the object of each record, nullptr for skipped records.
+		struct PendingPointer
 		{
-			std::size_t typeHash;
-			inFile.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash));
-			if (!inFile)
-			{
-//#if LOGGER_LIBRARY_AVAILABLE == 1
-//				getLogger().logError("Failed to read objects");
-//#endif
-				return true;//return false; // EOF or read error
-			}
+			ISerializable* obj;
+			const PointerMember* member;
+			std::uintptr_t target;
+		};
+		// Copies of duplicates take the pointers of their original once these are resolved
+		struct CopiedObject
+		{
+			ISerializable* copy;
+			const ISerializable* original;
+			const std::vector<PointerMember>* pointers;
+		};
+		std::vector<ISerializable*> records;
+		std::vector<PendingPointer> pendingPointers;
+		std::vector<CopiedObject> copiedObjects;
 
-			const auto& it = mataMap.find(typeHash);
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			records.push_back(nullptr);
+			const auto& it = mataMap.find(header.typeHash);
 			if (it != mataMap.end()) {
 				const ObjectMetaData& meta = it->second;
+
+				PayloadLayout layout;
+				if (!getPayloadLayout(meta, settings, layout))
+					break;
+				if (!checkPayloadSize(header, meta, layout, settings))
+				{
+					if (!skipPayload(source, header, &meta, settings))
+						break;
+					continue;
+				}
 				// Call the factory function to load the object
 				ISerializable* obj = meta.create();
-
-				char* startData = reinterpret_cast<char*>(obj);
-				size_t byteCount = meta.size;
-				if (!vTableMetaData.serializeVtable)
+#if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
+				logger.logInfo("Deserializing object of type: " + meta.name + " [" + std::to_string(layout.size) + " bytes]");
+#endif
+				bool complete;
+				if (layout.pointers)
 				{
-					byteCount -= vTableMetaData.size;
-					if (vTableMetaData.location == VTableMetaData::Location::Beginning)
+					// The stored target positions get lost when the payload is decoded
+					char* payload = getScratchBuffer(layout.size);
+					complete = source.read(payload, layout.size);
+					for (std::size_t i = 0; complete && i < layout.pointers->size(); ++i)
 					{
-						startData += vTableMetaData.size;
+						std::size_t position;
+						std::uintptr_t target;
+						if (!getFieldPosition(layout, (*layout.pointers)[i].offset, sizeof(target), position))
+							continue;
+						std::memcpy(&target, payload + position, sizeof(target));
+						if (target)
+							pendingPointers.push_back({ obj, &(*layout.pointers)[i], target });
 					}
+					if (complete)
+						decodePayload(payload, obj, layout);
 				}
-#if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
-				logger.logInfo("Deserializing object of type: " + meta.name + " [" + std::to_string(byteCount) + " bytes]");
+				else
+				{
+					complete = readPayload(source, obj, layout);
+				}
+				if (!complete)
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					getLogger().logError("Truncated object of type: " + meta.name);
+#endif
+					delete obj;
+					break;
+				}
+				objs.push_back(obj);
+				records.back() = obj;
+				if (const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj))
+				{
+					if (objWithID->getID() >= nextFreeID)
+						nextFreeID = objWithID->getID() + 1;
+				}
+			}
+			else if (const ObjectMetaData* meta = findReferenceType(header.typeHash))
+			{
+				// Duplicate of the payload of an earlier record
+				std::uint64_t position;
+				if (settings.lengthFramedRecords && header.payloadSize != sizeof(position))
+				{
+					if (!skipPayload(source, header, nullptr, settings))
+						break;
+					continue;
+				}
+				if (!source.read(reinterpret_cast<char*>(&position), sizeof(position)))
+					break;
+				ISerializable* original = position + 1 < records.size() ? records[static_cast<std::size_t>(position)] : nullptr;
+				PayloadLayout layout;
+				if (!original || std::type_index(typeid(*original)).hash_code() != meta->typeHash ||
+					!getPayloadLayout(*meta, settings, layout))
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					getLogger().logWarning("Duplicate of type: " + meta->name + " refers to a missing record. Record skipped");
 #endif
-				inFile.read(startData, byteCount);
+					continue;
+				}
+				ISerializable* obj = original;
+				if (settings.duplicatePolicy == DuplicatePolicy::Copy)
+				{
+					obj = meta->create();
+					copyPayload(original, obj, layout);
+					if (layout.pointers)
+						copiedObjects.push_back({ obj, original, layout.pointers });
+				}
 				objs.push_back(obj);
+				records.back() = obj;
 			}
 			else
 			{
-				typeWithHashNotRegistered(typeHash);
-				// Assume maximum size struct and skip it (adjust if known max size is different)
-				inFile.ignore(1024);
+				if (!findTombstoneType(header.typeHash))
+					typeWithHashNotRegistered(header.typeHash);
+				if (!skipPayload(source, header, nullptr, settings))
+					break;
 			}
 		}
+		// One pass over the pointers, the targets are looked up by their record position
+		for (const PendingPointer& pointer : pendingPointers)
+			pointer.member->set(pointer.obj, pointer.target <= records.size() ? records[pointer.target - 1] : nullptr);
+		for (const CopiedObject& copied : copiedObjects)
+		{
+			for (const PointerMember& pointer : *copied.pointers)
+				pointer.set(copied.copy, const_cast<ISerializable*>(pointer.get(copied.original)));
+		}
+		// Newly created objects must not collide with the loaded IDs
+		IDAllocator::seed(nextFreeID);
 		return true;
 	}
 
 	
-	bool Serializer::overrideInFile(const std::string& filename, const ISerializableID* obj)
+	bool Serializer::overrideInFile(const std::string& filename, const ISerializableID* obj, const Settings& settings)
 	{
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
 		std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
 		if (!file.is_open())
 		{
@@ -157,9 +391,8 @@ namespace ObjectSerializer
 #endif
 			return false;
 		}
-		if (setCursorToID(file, obj->getID()))
+		if (setCursorToID(file, obj->getID(), settings))
 		{
-			const VTableMetaData& vTableMetaData = getVTableMetaData();
 			const auto& mataMap = getObjectMetaData();
 			std::size_t typeHash = std::type_index(typeid(*obj)).hash_code();
 			const auto& it = mataMap.find(typeHash);
@@ -167,31 +400,25 @@ namespace ObjectSerializer
 			{
 				const ObjectMetaData& meta = it->second;
 
-				file.write(reinterpret_cast<const char*>(&typeHash), sizeof(typeHash));
-				size_t byteCount = meta.size;
-				const char* startData = reinterpret_cast<const char*>(obj);
+				PayloadLayout layout;
+				if (!getPayloadLayout(meta, settings, layout))
+					return false;
 
-				if (!vTableMetaData.serializeVtable)
-				{
-					if (meta.size < vTableMetaData.size)
-					{
-#if LOGGER_LIBRARY_AVAILABLE == 1
-						getLogger().logError("Object size is less than vtable size. Type: " + meta.name);
-#endif
-						return false;
-					}
-					byteCount -= vTableMetaData.size;
-					if (vTableMetaData.location == VTableMetaData::Location::Beginning)
-					{
-						startData += vTableMetaData.size;
-					}
-				}
 #if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
-				getLogger().logInfo("Serializing object of type: " + meta.name + " [" + std::to_string(byteCount) + " bytes]");
+				getLogger().logInfo("Serializing object of type: " + meta.name + " [" + std::to_string(layout.size) + " bytes]");
 #endif
-				file.write(startData, byteCount);
+				const std::uint64_t offset = static_cast<std::uint64_t>(file.tellg());
+				std::vector<char> buffer;
+				BufferSink sink(buffer);
+				const ISerializable* record = obj;
+				if (!writeRecords(sink, &record, 1, typeHash, layout, settings) ||
+					!keepStoredPointers(file, offset, buffer.data(), buffer.size(), settings))
+					return false;
+				file.clear();
+				file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+				file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
 				file.close();
-				return true;
+				return !file.fail();
 			}
 			else
 			{
@@ -200,7 +427,7 @@ namespace ObjectSerializer
 		}
 		return false;
 	}
-	bool Serializer::loadFromFile(const std::string& filename, std::size_t objectID, ISerializableID*& obj)
+	bool Serializer::loadFromFile(const std::string& filename, std::size_t objectID, ISerializableID*& obj, const Settings& settings)
 	{
 		std::fstream inFile(filename, std::ios::binary | std::ios::in);
 		if (!inFile.is_open())
@@ -211,19 +438,18 @@ namespace ObjectSerializer
 			return false;
 		}
 		obj = nullptr;
-		if (setCursorToID(inFile, objectID))
+		if (setCursorToID(inFile, objectID, settings))
 		{
-			const VTableMetaData& vTableMetaData = getVTableMetaData();
 			const auto& mataMap = getObjectMetaData();
 
-			std::size_t typeHash;
-			inFile.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash));
-			if (!inFile)
+			StreamSource source(inFile);
+			RecordHeader header;
+			if (!readRecordHeader(source, header, settings))
 			{
 				return false; 
 			}
 
-			const auto& it = mataMap.find(typeHash);
+			const auto& it = mataMap.find(header.typeHash);
 
 			if (it != mataMap.end())
 			{
@@ -231,21 +457,24 @@ namespace ObjectSerializer
 				// Call the factory function to load the object
 				obj = dynamic_cast<ISerializableID*>(meta.create());
 
-				char* startData = reinterpret_cast<char*>(obj);
-				size_t byteCount = meta.size;
-				if (!vTableMetaData.serializeVtable)
+				PayloadLayout layout;
+				if (!obj || !getPayloadLayout(meta, settings, layout))
 				{
-					byteCount -= vTableMetaData.size;
-					if (vTableMetaData.location == VTableMetaData::Location::Beginning)
-					{
-						startData += vTableMetaData.size;
-					}
+					delete obj;
+					obj = nullptr;
+					return false;
 				}
 #if defined(OBJECT_SERIALIZER_DEBUG) && LOGGER_LIBRARY_AVAILABLE == 1
-				getLogger().logInfo("Deserializing object of type: " + meta.name + " [" + std::to_string(byteCount) + " bytes]");
+				getLogger().logInfo("Deserializing object of type: " + meta.name + " [" + std::to_string(layout.size) + " bytes]");
 #endif
-				inFile.read(startData, byteCount);
+				if (!readPayload(source, obj, layout))
+				{
+					delete obj;
+					obj = nullptr;
+					return false;
+				}
 				inFile.close();
+				IDAllocator::seed(obj->getID() + 1);
 				return true;
 			}
 		}
@@ -359,131 +588,1696 @@ namespace ObjectSerializer
 		return false;*/
 	}
 
-	bool Serializer::isTypeRegistered(const std::size_t typeHash)
-	{
-		auto& objectMetaData = getObjectMetaData();
-		return objectMetaData.find(typeHash) != objectMetaData.end();
-	}
-
-	void Serializer::typeWithHashNotRegistered(const std::size_t typeHash)
+	bool Serializer::loadFromFile(const std::string& filename, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings)
 	{
+		objs.assign(objectIDs.size(), nullptr);
+		FileSource source(filename);
+		if (!source.isOpen())
+		{
 #if LOGGER_LIBRARY_AVAILABLE == 1
-		getLogger().logError("Type with hash: " + std::to_string(typeHash) + " not registered");
-#else
-		OS_UNUSED(typeHash);
+			getLogger().logError("Failed to open file: " + filename);
 #endif
+			return false;
+		}
+
+		// ID -> positions in objectIDs which still wait for their object
+		std::unordered_map<std::size_t, std::vector<std::size_t>> pending;
+		for (std::size_t i = 0; i < objectIDs.size(); ++i)
+			pending[objectIDs[i]].push_back(i);
+
+		const auto& mataMap = getObjectMetaData();
+		std::size_t nextFreeID = 0;
+		RecordHeader header;
+		while (!pending.empty() && readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			PayloadLayout layout;
+			if (!meta || meta->idOffset == s_noID || !getPayloadLayout(*meta, settings, layout) ||
+				!checkPayloadSize(header, *meta, layout, settings))
+			{
+				if (!skipPayload(source, header, meta, settings))
+					break;
+				continue;
+			}
+
+			char* payload = getScratchBuffer(layout.size);
+			std::size_t id;
+			if (!source.read(payload, layout.size))
+				break;
+			if (!readID(payload, *meta, layout, id))
+				continue;
+			const auto& pendingIt = pending.find(id);
+			if (pendingIt == pending.end())
+				continue;
+
+			for (std::size_t position : pendingIt->second)
+			{
+				ISerializable* obj = meta->create();
+				decodePayload(payload, obj, layout);
+				objs[position] = dynamic_cast<ISerializableID*>(obj);
+			}
+			pending.erase(pendingIt);
+			nextFreeID = std::max(nextFreeID, id + 1);
+		}
+		IDAllocator::seed(nextFreeID);
+		return true;
 	}
-	void Serializer::typeNotRegistered(const ISerializable* obj)
+	bool Serializer::loadFromFile(const std::string& filename, const FileIndex& index, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings)
 	{
+		objs.assign(objectIDs.size(), nullptr);
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+		{
 #if LOGGER_LIBRARY_AVAILABLE == 1
-		getLogger().logError("Type: " + std::string(typeid(*obj).name()) + " not registered");
-#else
-		OS_UNUSED(obj);
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+
+		struct Request
+		{
+			std::uint64_t offset;
+			std::size_t size;
+			const ObjectMetaData* meta;
+			PayloadLayout layout;
+			std::size_t position;
+		};
+		const auto& mataMap = getObjectMetaData();
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		std::vector<Request> requests;
+		requests.reserve(objectIDs.size());
+		for (std::size_t i = 0; i < objectIDs.size(); ++i)
+		{
+			FileIndex::Entry entry;
+			if (!index.find(objectIDs[i], entry))
+				continue;
+			const auto& it = mataMap.find(entry.typeHash);
+			if (it == mataMap.end())
+				continue;
+			Request request{ entry.offset, 0, &it->second, {}, i };
+			if (!getPayloadLayout(it->second, settings, request.layout))
+				continue;
+			request.size = headerSize + request.layout.size;
+			requests.push_back(request);
+		}
+		std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b)
+			{
+				return a.offset < b.offset;
+			});
+
+		std::vector<RecordRange> ranges(requests.size());
+		for (std::size_t i = 0; i < requests.size(); ++i)
+			ranges[i] = { requests[i].offset, requests[i].size };
+
+		std::size_t nextFreeID = 0;
+		readRecordRanges(file, ranges, [&](std::size_t i, const char* record)
+			{
+				const Request& request = requests[i];
+				std::size_t typeHash;
+				std::size_t id;
+				std::memcpy(&typeHash, record, sizeof(typeHash));
+				const char* payload = record + headerSize;
+				// Protect against an index which does not match the file
+				if (typeHash != request.meta->typeHash ||
+					!readID(payload, *request.meta, request.layout, id) ||
+					id != objectIDs[request.position])
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					getLogger().logError("Index does not match the file: " + filename);
 #endif
+					return;
+				}
+				ISerializable* obj = request.meta->create();
+				decodePayload(payload, obj, request.layout);
+				objs[request.position] = dynamic_cast<ISerializableID*>(obj);
+				nextFreeID = std::max(nextFreeID, id + 1);
+			});
+		IDAllocator::seed(nextFreeID);
+		return true;
 	}
 
-	
-	bool Serializer::setCursorToID(std::fstream& file, std::size_t id)
+	bool Serializer::readAllOfType(const std::string& filename, std::size_t typeHash, const ObjectAllocator& allocate, const Settings& settings)
 	{
-		// go to the start of the file
-		file.seekg(0, std::ios::beg);
-		const VTableMetaData& vTableMetaData = getVTableMetaData();
 		const auto& mataMap = getObjectMetaData();
+		const auto& metaIt = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (metaIt == mataMap.end() || !getPayloadLayout(metaIt->second, settings, layout))
+		{
+			typeWithHashNotRegistered(typeHash);
+			return false;
+		}
+		const ObjectMetaData& meta = metaIt->second;
 
-		struct LoaderData
+		FileSource source(filename);
+		if (!source.isOpen())
 		{
-			ISerializableID* instance = nullptr;
-			Serializer::ObjectMetaData metaData;
-			LoaderData(ISerializableID* instance, const Serializer::ObjectMetaData& metaData)
-				: instance(instance)
-				, metaData(metaData)
-			{}
-			LoaderData(LoaderData&& other) noexcept
-				: instance(other.instance)
-				, metaData(std::move(other.metaData))
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+
+		std::size_t nextFreeID = 0;
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			if (header.typeHash != typeHash || !checkPayloadSize(header, meta, layout, settings))
 			{
-				other.instance = nullptr;
+				const auto& it = mataMap.find(header.typeHash);
+				if (!skipPayload(source, header, it != mataMap.end() ? &it->second : nullptr, settings))
+					break;
+				continue;
 			}
-			~LoaderData()
+			ISerializable* obj = allocate();
+			if (!readPayload(source, obj, layout))
+				break;
+			if (meta.idOffset != s_noID)
 			{
-				delete instance;
+				std::size_t id;
+				std::memcpy(&id, reinterpret_cast<const char*>(obj) + meta.idOffset, sizeof(id));
+				nextFreeID = std::max(nextFreeID, id + 1);
 			}
-		};
-
-		std::unordered_map<std::size_t, LoaderData> objectMap;
-		for (const auto& it : mataMap)
+		}
+		IDAllocator::seed(nextFreeID);
+		return true;
+	}
+	bool Serializer::readAllOfType(const std::string& filename, const FileIndex& index, std::size_t typeHash, const ObjectAllocator& allocate, const Settings& settings)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const auto& metaIt = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (metaIt == mataMap.end() || !getPayloadLayout(metaIt->second, settings, layout))
 		{
-			ISerializable* obj = it.second.create();
-			ISerializableID* id = dynamic_cast<ISerializableID*>(obj);
-			if (id)
-			{
-				objectMap.insert({ it.second.typeHash, LoaderData(id, it.second) });
-			}
-			else
-				delete obj;
+			typeWithHashNotRegistered(typeHash);
+			return false;
 		}
+		const ObjectMetaData& meta = metaIt->second;
 
-		while (file)
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
 		{
-			std::size_t typeHash;
-			file.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash));
-			if (!file)
-			{
 #if LOGGER_LIBRARY_AVAILABLE == 1
-				getLogger().logError("Failed to read objects");
+			getLogger().logError("Failed to open file: " + filename);
 #endif
-				return false; // EOF or read error
-			}
-
-			const auto& it = mataMap.find(typeHash);
+			return false;
+		}
 
-			if (it != mataMap.end()) {
-				const auto& loaderIt = objectMap.find(typeHash);
-				const ObjectMetaData& meta = it->second;
-				// Call the factory function to load the object
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		std::span<const std::uint64_t> offsets = index.getOffsets(typeHash);
+		std::vector<RecordRange> ranges(offsets.size());
+		for (std::size_t i = 0; i < offsets.size(); ++i)
+			ranges[i] = { offsets[i], headerSize + layout.size };
 
-				if (loaderIt != objectMap.end())
+		bool indexMatches = true;
+		std::size_t nextFreeID = 0;
+		bool success = readRecordRanges(file, ranges, [&](std::size_t, const char* record)
+			{
+				std::size_t recordType;
+				std::memcpy(&recordType, record, sizeof(recordType));
+				if (recordType != typeHash)
 				{
-					char* startData = reinterpret_cast<char*>(loaderIt->second.instance);
-					size_t byteCount = meta.size;
-					if (!vTableMetaData.serializeVtable)
+					indexMatches = false;
+					return;
+				}
+				ISerializable* obj = allocate();
+				decodePayload(record + headerSize, obj, layout);
+				std::size_t id;
+				if (readID(record + headerSize, meta, layout, id))
+					nextFreeID = std::max(nextFreeID, id + 1);
+			});
+		IDAllocator::seed(nextFreeID);
+		if (!indexMatches)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Index does not match the file: " + filename);
+#endif
+			return false;
+		}
+		return success;
+	}
+
+	bool Serializer::loadFromFile(const std::string& filename, const BloomFilter& filter, std::size_t objectID, ISerializableID*& obj, const Settings& settings)
+	{
+		obj = nullptr;
+		if (!filter.mightContain(objectID))
+			return false;
+		return loadFromFile(filename, objectID, obj, settings);
+	}
+	bool Serializer::loadFromFile(const std::string& filename, const BloomFilter& filter, std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs, const Settings& settings)
+	{
+		objs.assign(objectIDs.size(), nullptr);
+		std::vector<std::size_t> candidates;
+		std::vector<std::size_t> positions;
+		for (std::size_t i = 0; i < objectIDs.size(); ++i)
+		{
+			if (filter.mightContain(objectIDs[i]))
+			{
+				candidates.push_back(objectIDs[i]);
+				positions.push_back(i);
+			}
+		}
+		// Absent IDs would make the scan run to the end of the file
+		if (candidates.empty())
+			return true;
+		std::vector<ISerializableID*> found;
+		bool success = loadFromFile(filename, candidates, found, settings);
+		for (std::size_t i = 0; i < found.size(); ++i)
+			objs[positions[i]] = found[i];
+		return success;
+	}
+	bool Serializer::loadRange(const std::string& filename, std::size_t lowID, std::size_t highID, std::vector<ISerializableID*>& objs, const Settings& settings)
+	{
+		objs.clear();
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+		std::uint64_t start = 0;
+		const bool sorted = findSparseStart(file, lowID, start);
+		file.clear();
+		file.seekg(static_cast<std::streamoff>(start), std::ios::beg);
+
+		const auto& mataMap = getObjectMetaData();
+		std::size_t nextFreeID = 0;
+		StreamSource source(file);
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			PayloadLayout layout;
+			if (!meta || meta->idOffset == s_noID || !getPayloadLayout(*meta, settings, layout) ||
+				!checkPayloadSize(header, *meta, layout, settings))
+			{
+				if (!meta && !findTombstoneType(header.typeHash) && !findReferenceType(header.typeHash))
+					typeWithHashNotRegistered(header.typeHash);
+				if (!skipPayload(source, header, meta, settings))
+					break;
+				continue;
+			}
+
+			char* payload = getScratchBuffer(layout.size);
+			std::size_t id;
+			if (!source.read(payload, layout.size))
+				break;
+			if (!readID(payload, *meta, layout, id) || id < lowID)
+				continue;
+			if (id > highID)
+			{
+				if (sorted)
+					break;
+				continue;
+			}
+			ISerializable* obj = meta->create();
+			decodePayload(payload, obj, layout);
+			objs.push_back(dynamic_cast<ISerializableID*>(obj));
+			nextFreeID = std::max(nextFreeID, id + 1);
+		}
+		IDAllocator::seed(nextFreeID);
+		return true;
+	}
+	bool Serializer::removeFromFile(const std::string& filename, std::size_t objectID, const Settings& settings)
+	{
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+		if (!setCursorToID(file, objectID, settings))
+			return false;
+
+		std::streampos position = file.tellg();
+		std::size_t typeHash;
+		if (!file.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash)))
+			return false;
+		std::size_t tombstone = getTombstoneHash(typeHash);
+		file.seekp(position);
+		file.write(reinterpret_cast<const char*>(&tombstone), sizeof(tombstone));
+		return file.good();
+	}
+	bool Serializer::removeFromFile(const std::string& filename, FileIndex& index, std::size_t objectID, const Settings& settings)
+	{
+		OS_UNUSED(settings);
+		FileIndex::Entry entry;
+		if (!index.find(objectID, entry))
+			return false;
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+
+		std::size_t typeHash = 0;
+		file.seekg(static_cast<std::streamoff>(entry.offset));
+		file.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash));
+		if (!file || typeHash != entry.typeHash)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Index does not match the file: " + filename);
+#endif
+			return false;
+		}
+		std::size_t tombstone = getTombstoneHash(typeHash);
+		file.seekp(static_cast<std::streamoff>(entry.offset));
+		file.write(reinterpret_cast<const char*>(&tombstone), sizeof(tombstone));
+		if (!file.good())
+			return false;
+		index.remove(objectID);
+		return true;
+	}
+	bool Serializer::addToFile(const std::string& filename, const ISerializableID* obj, const Settings& settings)
+	{
+		if (!obj)
+			return false;
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		if (!std::filesystem::exists(filename))
+			std::ofstream(filename, std::ios::binary);
+		std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+		// Neither appended records nor records in free slots would be in the sparse index
+		std::uint64_t indexOffset = 0;
+		std::uint64_t indexCount = 0;
+		if (findSparseIndex(file, indexOffset, indexCount))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Objects can't be added to the sorted file: " + filename);
+#endif
+			return false;
+		}
+		file.clear();
+		file.seekg(0, std::ios::beg);
+
+		std::uint64_t offset = 0;
+		if (!findFreeSlot(file, std::type_index(typeid(*obj)).hash_code(), settings, offset))
+		{
+			file.clear();
+			file.seekg(0, std::ios::end);
+			offset = static_cast<std::uint64_t>(file.tellg());
+		}
+		std::size_t typeHash;
+		return writeRecordAt(file, offset, obj, typeHash, settings);
+	}
+	bool Serializer::addToFile(const std::string& filename, FileIndex& index, const ISerializableID* obj, const Settings& settings)
+	{
+		if (!obj)
+			return false;
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		if (!std::filesystem::exists(filename))
+			std::ofstream(filename, std::ios::binary);
+		std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+		if (!file.is_open())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+		// Neither appended records nor records in free slots would be in the sparse index
+		std::uint64_t indexOffset = 0;
+		std::uint64_t indexCount = 0;
+		if (findSparseIndex(file, indexOffset, indexCount))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Objects can't be added to the sorted file: " + filename);
+#endif
+			return false;
+		}
+		file.clear();
+		file.seekg(0, std::ios::beg);
+
+		std::uint64_t offset = 0;
+		const bool reused = index.takeFreeOffset(std::type_index(typeid(*obj)).hash_code(), offset);
+		if (!reused)
+		{
+			file.seekg(0, std::ios::end);
+			offset = static_cast<std::uint64_t>(file.tellg());
+		}
+		std::size_t typeHash;
+		if (!writeRecordAt(file, offset, obj, typeHash, settings))
+			return false;
+		index.insert(obj->getID(), FileIndex::Entry{ typeHash, offset });
+		return true;
+	}
+	bool Serializer::compactFile(const std::string& filename, const Settings& settings)
+	{
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		std::error_code error;
+		const auto sizeBefore = std::filesystem::file_size(filename, error);
+		const auto timeBefore = std::filesystem::last_write_time(filename, error);
+		if (error)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + filename);
+#endif
+			return false;
+		}
+
+		const std::string compactFilename = getTempFilename(filename, ".compact");
+		{
+			FileSource source(filename);
+			SyncFileSink file(compactFilename);
+			if (!source.isOpen() || !file.isOpen())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				getLogger().logError("Failed to open file: " + (source.isOpen() ? compactFilename : filename));
+#endif
+				if (file.isOpen())
+				{
+					file.close();
+					std::filesystem::remove(compactFilename, error);
+				}
+				return false;
+			}
+			BackgroundSink sink(file);
+			const auto fail = [&]()
+				{
+					sink.flush();
+					file.close();
+					std::filesystem::remove(compactFilename, error);
+					return false;
+				};
+
+			// Records of sorted files end at their sparse index
+			std::uint64_t recordsEnd = sizeBefore;
+			{
+				std::ifstream file(filename, std::ios::binary);
+				std::uint64_t indexCount = 0;
+				if (!findSparseIndex(file, recordsEnd, indexCount))
+					recordsEnd = sizeBefore;
+			}
+
+			const auto& mataMap = getObjectMetaData();
+			const std::size_t headerSize = getRecordHeaderSize(settings);
+			char header[2 * sizeof(std::size_t)];
+			RecordHeader record;
+
+			// Stored pointers and references to duplicates refer to record positions, which move
+			// when deleted records get dropped. Pointers may refer to later records, so the
+			// positions of the deleted records get collected first. References only refer to
+			// earlier records, for them collecting the positions while copying is enough.
+			std::vector<std::uintptr_t> deleted;
+			const bool collectDeleted = !hasPointerMembers();
+			if (!collectDeleted)
+			{
+				FileSource records(filename);
+				for (std::uintptr_t position = 0; readRecordHeader(records, record, settings); ++position)
+				{
+					const auto& it = mataMap.find(record.typeHash);
+					const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+					if (!meta && findTombstoneType(record.typeHash))
+						deleted.push_back(position);
+					if (!skipPayload(records, record, meta, settings))
+						break;
+				}
+			}
+
+			// Records stay in order, the sparse index of sorted files gets rebuilt
+			std::vector<SparseIndexEntry> sparseIndex;
+			std::size_t indexedCount = 0;
+			std::uint64_t offset = 0;
+			std::uint64_t consumed = 0;
+			for (std::uintptr_t recordPosition = 0; readRecordHeader(source, record, settings); ++recordPosition)
+			{
+				const auto& it = mataMap.find(record.typeHash);
+				const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+				const bool reference = !meta && findReferenceType(record.typeHash);
+				if (!meta && !reference)
+				{
+					if (const ObjectMetaData* tombstone = findTombstoneType(record.typeHash))
 					{
-						byteCount -= vTableMetaData.size;
-						if (vTableMetaData.location == VTableMetaData::Location::Beginning)
+						if (collectDeleted)
+							deleted.push_back(recordPosition);
+						std::size_t skipped = record.payloadSize;
+						PayloadLayout tombstoneLayout;
+						if (!settings.lengthFramedRecords)
 						{
-							startData += vTableMetaData.size;
+							if (!getPayloadLayout(*tombstone, settings, tombstoneLayout))
+								return fail();
+							skipped = tombstoneLayout.size;
 						}
+						if (!source.skip(skipped))
+							break; // Truncated, detected behind the loop
+						consumed += headerSize + skipped;
+						continue;
+					}
+					if (!settings.lengthFramedRecords)
+					{
+						// Records of unknown size can't be copied
+						typeWithHashNotRegistered(record.typeHash);
+						return fail();
 					}
-					file.read(startData, byteCount);
+				}
 
-					if (loaderIt->second.instance->getID() == id)
+				// Copy the record as it is
+				std::size_t payloadSize = record.payloadSize;
+				PayloadLayout layout;
+				if (!settings.lengthFramedRecords)
+				{
+					if (reference)
+						payloadSize = sizeof(std::uint64_t);
+					else if (!getPayloadLayout(*meta, settings, layout))
+						return fail();
+					else
+						payloadSize = layout.size;
+				}
+				const bool decodable = meta && (!settings.lengthFramedRecords || getPayloadLayout(*meta, settings, layout)) &&
+									   layout.size == payloadSize;
+				char* payload = getScratchBuffer(payloadSize);
+				encodeRecordHeader(header, record.typeHash, payloadSize, settings);
+				bool success = source.read(payload, payloadSize);
+				if (success && decodable && layout.pointers)
+				{
+					for (const PointerMember& pointer : *layout.pointers)
 					{
-						// move back to the start of the object
-						file.seekg(-byteCount - sizeof(typeHash), std::ios::cur);
-						return true;
+						std::size_t position;
+						std::uintptr_t target;
+						if (!getFieldPosition(layout, pointer.offset, sizeof(target), position))
+							continue;
+						std::memcpy(&target, payload + position, sizeof(target));
+						if (!target)
+							continue;
+						const auto& next = std::lower_bound(deleted.begin(), deleted.end(), target - 1);
+						if (next != deleted.end() && *next == target - 1)
+							target = 0; // The target got deleted
+						else
+							target -= static_cast<std::uintptr_t>(next - deleted.begin());
+						std::memcpy(payload + position, &target, sizeof(target));
 					}
 				}
-				else
+				if (success && reference && payloadSize == sizeof(std::uint64_t))
 				{
-					// Skip the amount of bytes for this object
-					size_t skipSize = meta.size;
-					skipSize -= vTableMetaData.size * size_t(!vTableMetaData.serializeVtable);
-					file.ignore(skipSize);
+					// The original has no ID and is never deleted
+					std::uint64_t original;
+					std::memcpy(&original, payload, sizeof(original));
+					original -= static_cast<std::uint64_t>(std::lower_bound(deleted.begin(), deleted.end(), original) - deleted.begin());
+					std::memcpy(payload, &original, sizeof(original));
+				}
+				if (!success ||
+					!sink.write(header, headerSize) ||
+					!sink.write(payload, payloadSize))
+				{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+					getLogger().logError("Failed to compact file: " + filename);
+#endif
+					return fail();
+				}
+				std::size_t id;
+				if (settings.sparseIndexInterval != 0 && decodable && meta->idOffset != s_noID &&
+					readID(payload, *meta, layout, id) &&
+					indexedCount++ % settings.sparseIndexInterval == 0)
+				{
+					sparseIndex.push_back({ id, offset });
 				}
+				offset += headerSize + payloadSize;
+				consumed += headerSize + payloadSize;
+			}
+			// A record could not be read completely, copying the rest would lose it
+			if (consumed != recordsEnd)
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				getLogger().logError("Failed to read the records of file: " + filename);
+#endif
+				return fail();
+			}
+			if (settings.sparseIndexInterval != 0 && !writeSparseIndex(sink, sparseIndex, offset))
+				return fail();
+			// The copy replaces the only other one, it must be on the disk before the rename
+			if (!sink.flush() || !file.sync())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				getLogger().logError("Failed to write file: " + compactFilename);
+#endif
+				return fail();
 			}
+			file.close();
 		}
-		return false;
+
+		// Someone wrote to the file while it was copied, keep the original
+		if (std::filesystem::file_size(filename, error) != sizeBefore ||
+			std::filesystem::last_write_time(filename, error) != timeBefore)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("File changed while compacting: " + filename);
+#endif
+			std::filesystem::remove(compactFilename, error);
+			return false;
+		}
+		// Replaces the original in one step, readers see either the old or the new file
+		std::filesystem::rename(compactFilename, filename, error);
+		if (error)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to replace file: " + filename + " " + error.message());
+#endif
+			std::filesystem::remove(compactFilename, error);
+			return false;
+		}
+		if (settings.syncPolicy == SyncPolicy::Full &&
+			!SyncFileSink::syncDirectory(std::filesystem::absolute(filename, error).parent_path().string()))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to sync the directory of file: " + filename);
+#endif
+			return false;
+		}
+		return true;
+	}
+	std::future<bool> Serializer::compactFileAsync(const std::string& filename, const Settings& settings)
+	{
+		return std::async(std::launch::async, [filename, settings]()
+			{
+				return compactFile(filename, settings);
+			});
 	}
 
+	std::size_t Serializer::getObjectSize(const ISerializable* obj)
+	{
+		if (!obj)
+			return 0;
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeid(*obj).hash_code());
+		if (it == mataMap.end())
+			return 0;
+		return it->second.size;
+	}
+	bool Serializer::isTypeRegistered(const std::size_t typeHash)
+	{
+		auto& objectMetaData = getObjectMetaData();
+		return objectMetaData.find(typeHash) != objectMetaData.end();
+	}
 
-	std::unordered_map<std::size_t, Serializer::ObjectMetaData>& Serializer::getObjectMetaData()
+	const Serializer::ObjectMetaData* Serializer::findTombstoneType(std::size_t typeHash)
 	{
-		static std::unordered_map<std::size_t, ObjectMetaData> objectMetaData;
-		return objectMetaData;
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(getTombstoneHash(typeHash));
+		return it != mataMap.end() ? &it->second : nullptr;
+	}
+	const Serializer::ObjectMetaData* Serializer::findReferenceType(std::size_t typeHash)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(getReferenceHash(typeHash));
+		return it != mataMap.end() ? &it->second : nullptr;
+	}
+	std::uint64_t Serializer::hashPayload(const char* payload, std::size_t size)
+	{
+		// Word wise multiply and shift mix, candidates get compared byte by byte afterwards
+		std::uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+		std::size_t i = 0;
+		for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+		{
+			std::uint64_t word;
+			std::memcpy(&word, payload + i, sizeof(word));
+			hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+			hash ^= hash >> 29;
+		}
+		if (i < size)
+		{
+			std::uint64_t word = 0;
+			std::memcpy(&word, payload + i, size - i);
+			hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+		}
+		hash = (hash ^ (hash >> 32)) * 0x94d049bb133111ebULL;
+		return hash ^ (hash >> 29);
+	}
+	void Serializer::copyPayload(const ISerializable* source, ISerializable* destination, const PayloadLayout& layout)
+	{
+		const char* src = reinterpret_cast<const char*>(source);
+		char* dst = reinterpret_cast<char*>(destination);
+		if (!layout.fields)
+		{
+			std::memcpy(dst + layout.offset, src + layout.offset, layout.size);
+			return;
+		}
+		for (const FieldSpan& field : *layout.fields)
+			std::memcpy(dst + field.offset, src + field.offset, field.size);
+	}
+	bool Serializer::findFreeSlot(std::istream& stream, std::size_t typeHash, const Settings& settings, std::uint64_t& offset)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		const std::size_t tombstone = getTombstoneHash(typeHash);
+		StreamSource source(stream);
+		std::uint64_t position = 0;
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const ObjectMetaData* meta = it != mataMap.end() ? &it->second : findTombstoneType(header.typeHash);
+			PayloadLayout layout;
+			std::size_t payloadSize = header.payloadSize;
+			if (!settings.lengthFramedRecords)
+			{
+				// Without framing the rest of the file can't be searched
+				if (!meta && findReferenceType(header.typeHash))
+					payloadSize = sizeof(std::uint64_t);
+				else if (!meta || !getPayloadLayout(*meta, settings, layout))
+					return false;
+				else
+					payloadSize = layout.size;
+			}
+			if (header.typeHash == tombstone)
+			{
+				offset = position;
+				return true;
+			}
+			if (!source.skip(payloadSize))
+				return false;
+			position += headerSize + payloadSize;
+		}
+		return false;
+	}
+	bool Serializer::writeRecordAt(std::fstream& file, std::uint64_t offset, const ISerializableID* obj, std::size_t& typeHash, const Settings& settings)
+	{
+		typeHash = std::type_index(typeid(*obj)).hash_code();
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeHash);
+		if (it == mataMap.end())
+		{
+			typeNotRegistered(obj);
+			return false;
+		}
+		PayloadLayout layout;
+		if (!getPayloadLayout(it->second, settings, layout))
+			return false;
+
+		file.clear();
+		file.seekp(static_cast<std::streamoff>(offset));
+		StreamSink sink(file);
+		const ISerializable* record = obj;
+		return writeRecords(sink, &record, 1, typeHash, layout, settings);
+	}
+	void Serializer::typeWithHashNotRegistered(const std::size_t typeHash)
+	{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+		getLogger().logError("Type with hash: " + std::to_string(typeHash) + " not registered");
+#else
+		OS_UNUSED(typeHash);
+#endif
+	}
+	void Serializer::typeNotRegistered(const ISerializable* obj)
+	{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+		getLogger().logError("Type: " + std::string(typeid(*obj).name()) + " not registered");
+#else
+		OS_UNUSED(obj);
+#endif
+	}
+
+	
+	bool Serializer::setCursorToID(std::fstream& file, std::size_t id, const Settings& settings)
+	{
+		// go to the start of the file, or of the part which can hold the ID in sorted files
+		std::uint64_t start = 0;
+		const bool sorted = findSparseStart(file, id, start);
+		file.clear();
+		file.seekg(static_cast<std::streamoff>(start), std::ios::beg);
+		const auto& mataMap = getObjectMetaData();
+
+		struct LoaderData
+		{
+			ISerializableID* instance = nullptr;
+			Serializer::ObjectMetaData metaData;
+			LoaderData(ISerializableID* instance, const Serializer::ObjectMetaData& metaData)
+				: instance(instance)
+				, metaData(metaData)
+			{}
+			LoaderData(LoaderData&& other) noexcept
+				: instance(other.instance)
+				, metaData(std::move(other.metaData))
+			{
+				other.instance = nullptr;
+			}
+			~LoaderData()
+			{
+				delete instance;
+			}
+		};
+
+		std::unordered_map<std::size_t, LoaderData> objectMap;
+		for (const auto& it : mataMap)
+		{
+			ISerializable* obj = it.second.create();
+			ISerializableID* id = dynamic_cast<ISerializableID*>(obj);
+			if (id)
+			{
+				objectMap.insert({ it.second.typeHash, LoaderData(id, it.second) });
+			}
+			else
+				delete obj;
+		}
+
+		StreamSource source(file);
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			const auto& loaderIt = objectMap.find(header.typeHash);
+			PayloadLayout layout;
+			if (meta && loaderIt != objectMap.end() && getPayloadLayout(*meta, settings, layout) &&
+				checkPayloadSize(header, *meta, layout, settings))
+			{
+				if (!readPayload(source, loaderIt->second.instance, layout))
+					return false;
+
+				if (loaderIt->second.instance->getID() == id)
+				{
+					// move back to the start of the object
+					file.seekg(-static_cast<std::streamoff>(layout.size + getRecordHeaderSize(settings)), std::ios::cur);
+					return true;
+				}
+				if (sorted && loaderIt->second.instance->getID() > id)
+					return false;
+			}
+			else if (!skipPayload(source, header, meta, settings))
+			{
+				return false;
+			}
+		}
+		return false;
+	}
+
+
+	std::unordered_map<std::size_t, Serializer::ObjectMetaData>& Serializer::getObjectMetaData()
+	{
+		static std::unordered_map<std::size_t, ObjectMetaData> objectMetaData;
+		return objectMetaData;
+	}
+	bool Serializer::getPayloadLayout(const ObjectMetaData& meta, const Settings& settings, PayloadLayout& layout)
+	{
+		layout.offset = 0;
+		layout.size = meta.size;
+		layout.fields = nullptr;
+		layout.pointers = meta.pointers.empty() ? nullptr : &meta.pointers;
+		if (settings.packedEncoding && !meta.fields.empty())
+		{
+			layout.size = meta.packedSize;
+			layout.fields = &meta.fields;
+			return true;
+		}
+		if (settings.serializeVtable)
+			return true;
+
+		const VTableMetaData& vtable = settings.customVtableLayout ? settings.vtable : meta.vtable;
+		if (meta.size < vtable.size)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Object size is less than vtable size. Type: " + meta.name);
+#endif
+			return false;
+		}
+		layout.size -= vtable.size;
+		if (vtable.location == VTableMetaData::Location::Beginning)
+		{
+			layout.offset = vtable.size;
+		}
+		return true;
+	}
+
+	void Serializer::setMemberLayout(const std::size_t typeHash, std::vector<FieldSpan>&& fields)
+	{
+		auto& objectMetaData = getObjectMetaData();
+		const auto& it = objectMetaData.find(typeHash);
+		if (it == objectMetaData.end())
+		{
+			typeWithHashNotRegistered(typeHash);
+			return;
+		}
+		it->second.members = fields;
+
+		std::sort(fields.begin(), fields.end(), [](const FieldSpan& a, const FieldSpan& b)
+			{
+				return a.offset < b.offset;
+			});
+		// Merge adjacent and overlapping members so that they get copied at once
+		std::vector<FieldSpan> merged;
+		std::size_t packedSize = 0;
+		for (const FieldSpan& field : fields)
+		{
+			if (!merged.empty() && field.offset <= merged.back().offset + merged.back().size)
+			{
+				std::size_t end = std::max(merged.back().offset + merged.back().size, field.offset + field.size);
+				packedSize += end - (merged.back().offset + merged.back().size);
+				merged.back().size = end - merged.back().offset;
+			}
+			else
+			{
+				merged.push_back(field);
+				packedSize += field.size;
+			}
+		}
+		it->second.fields = std::move(merged);
+		it->second.packedSize = packedSize;
+	}
+	void Serializer::setPointerLayout(const std::size_t typeHash, std::vector<PointerMember>&& pointers)
+	{
+		auto& objectMetaData = getObjectMetaData();
+		const auto& it = objectMetaData.find(typeHash);
+		if (it == objectMetaData.end())
+		{
+			typeWithHashNotRegistered(typeHash);
+			return;
+		}
+		it->second.pointers = std::move(pointers);
+	}
+	bool Serializer::hasPointerMembers()
+	{
+		for (const auto& it : getObjectMetaData())
+		{
+			if (!it.second.pointers.empty())
+				return true;
+		}
+		return false;
+	}
+
+	bool Serializer::hasPointerMembers(const std::vector<ISerializable*>& objs)
+	{
+		const auto& mataMap = getObjectMetaData();
+		std::size_t lastTypeHash = 0;
+		for (const ISerializable* obj : objs)
+		{
+			const std::size_t typeHash = std::type_index(typeid(*obj)).hash_code();
+			if (typeHash == lastTypeHash)
+				continue;
+			lastTypeHash = typeHash;
+			const auto& it = mataMap.find(typeHash);
+			if (it != mataMap.end() && !it->second.pointers.empty())
+				return true;
+		}
+		return false;
+	}
+	bool Serializer::keepStoredPointers(std::istream& file, std::uint64_t offset, char* record, std::size_t size, const Settings& settings)
+	{
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		std::size_t typeHash = 0;
+		if (size < headerSize)
+			return false;
+		std::memcpy(&typeHash, record, sizeof(typeHash));
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (it == mataMap.end() || !getPayloadLayout(it->second, settings, layout) || size != headerSize + layout.size)
+			return false;
+
+		// Writing over a record of another size would damage the records behind it
+		file.clear();
+		file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+		StreamSource source(file);
+		RecordHeader stored;
+		if (!readRecordHeader(source, stored, settings) || stored.typeHash != typeHash ||
+			!checkPayloadSize(stored, it->second, layout, settings))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("The record at offset " + std::to_string(offset) + " has another type or size than its replacement");
+#endif
+			return false;
+		}
+		if (!layout.pointers)
+			return true;
+		char* payload = getScratchBuffer(layout.size);
+		if (!source.read(payload, layout.size))
+			return false;
+		for (const PointerMember& pointer : *layout.pointers)
+		{
+			std::size_t position;
+			if (getFieldPosition(layout, pointer.offset, sizeof(std::uintptr_t), position))
+				std::memcpy(record + headerSize + position, payload + position, sizeof(std::uintptr_t));
+		}
+		return true;
+	}
+	bool Serializer::writePayload(IDataSink& sink, const ISerializable* obj, const PayloadLayout& layout)
+	{
+		const char* data = reinterpret_cast<const char*>(obj);
+		if (!layout.fields)
+			return sink.write(data + layout.offset, layout.size);
+
+		char* buffer = getScratchBuffer(layout.size);
+		char* packed = buffer;
+		for (const FieldSpan& field : *layout.fields)
+		{
+			std::memcpy(packed, data + field.offset, field.size);
+			packed += field.size;
+		}
+		return sink.write(buffer, layout.size);
+	}
+	bool Serializer::readPayload(IDataSource& source, ISerializable* obj, const PayloadLayout& layout)
+	{
+		char* data = reinterpret_cast<char*>(obj);
+		if (!layout.fields)
+		{
+			if (!source.read(data + layout.offset, layout.size))
+				return false;
+			clearPointers(obj, layout);
+			return true;
+		}
+
+		char* buffer = getScratchBuffer(layout.size);
+		if (!source.read(buffer, layout.size))
+			return false;
+		decodePayload(buffer, obj, layout);
+		return true;
+	}
+	void Serializer::decodePayload(const char* payload, ISerializable* obj, const PayloadLayout& layout)
+	{
+		char* data = reinterpret_cast<char*>(obj);
+		if (!layout.fields)
+		{
+			std::memcpy(data + layout.offset, payload, layout.size);
+		}
+		else
+		{
+			for (const FieldSpan& field : *layout.fields)
+			{
+				std::memcpy(data + field.offset, payload, field.size);
+				payload += field.size;
+			}
+		}
+		clearPointers(obj, layout);
+	}
+	void Serializer::encodePointers(char* payload, const ISerializable* obj, const PayloadLayout& layout, const PointerTable* pointerTable)
+	{
+		for (const PointerMember& pointer : *layout.pointers)
+		{
+			std::size_t position;
+			if (!getFieldPosition(layout, pointer.offset, sizeof(std::uintptr_t), position))
+				continue;
+			std::uintptr_t target = 0;
+			if (const ISerializable* targetObj = pointer.get(obj))
+			{
+				if (pointerTable)
+				{
+					const auto& it = pointerTable->find(targetObj);
+					if (it != pointerTable->end())
+						target = it->second;
+				}
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				if (!target)
+					getLogger().logWarning("Pointer target is not saved with the object, it gets stored as nullptr");
+#endif
+			}
+			std::memcpy(payload + position, &target, sizeof(target));
+		}
+	}
+	void Serializer::clearPointers(ISerializable* obj, const PayloadLayout& layout)
+	{
+		if (!layout.pointers)
+			return;
+		// The payload holds record positions, not addresses
+		for (const PointerMember& pointer : *layout.pointers)
+		{
+			std::size_t position;
+			if (getFieldPosition(layout, pointer.offset, sizeof(std::uintptr_t), position))
+				pointer.set(obj, nullptr);
+		}
+	}
+	bool Serializer::decodeRecord(std::size_t typeHash, const char* payload, std::size_t size, ISerializable* obj, const Settings& settings)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (it == mataMap.end() || !getPayloadLayout(it->second, settings, layout) || layout.size != size)
+			return false;
+		decodePayload(payload, obj, layout);
+		return true;
+	}
+
+	bool Serializer::readRecordRanges(std::ifstream& file, const std::vector<RecordRange>& ranges, const std::function<void(std::size_t, const char*)>& onRecord)
+	{
+		bool success = true;
+		std::vector<char> buffer;
+		std::size_t first = 0;
+		while (first < ranges.size())
+		{
+			// Merge records which are close to each other into one read
+			std::uint64_t begin = ranges[first].offset;
+			std::uint64_t end = begin + ranges[first].size;
+			std::size_t last = first + 1;
+			while (last < ranges.size() &&
+				   ranges[last].offset <= end + s_readCoalesceGap &&
+				   ranges[last].offset + ranges[last].size - begin <= s_maxCoalescedRead)
+			{
+				end = std::max<std::uint64_t>(end, ranges[last].offset + ranges[last].size);
+				++last;
+			}
+
+			buffer.resize(static_cast<std::size_t>(end - begin));
+			file.clear();
+			file.seekg(static_cast<std::streamoff>(begin));
+			file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			if (file)
+			{
+				for (std::size_t i = first; i < last; ++i)
+					onRecord(i, buffer.data() + (ranges[i].offset - begin));
+			}
+			else
+				success = false;
+			first = last;
+		}
+		return success;
+	}
+
+	bool Serializer::getIDPosition(const ObjectMetaData& meta, const PayloadLayout& layout, std::size_t& position)
+	{
+		if (meta.idOffset == s_noID)
+			return false;
+		return getFieldPosition(layout, meta.idOffset, sizeof(std::size_t), position);
+	}
+	bool Serializer::getFieldPosition(const PayloadLayout& layout, std::size_t offset, std::size_t size, std::size_t& position)
+	{
+		if (!layout.fields)
+		{
+			if (offset < layout.offset || offset + size > layout.offset + layout.size)
+				return false;
+			position = offset - layout.offset;
+			return true;
+		}
+		std::size_t packedOffset = 0;
+		for (const FieldSpan& field : *layout.fields)
+		{
+			if (offset >= field.offset && offset + size <= field.offset + field.size)
+			{
+				position = packedOffset + offset - field.offset;
+				return true;
+			}
+			packedOffset += field.size;
+		}
+		return false;
+	}
+	bool Serializer::readID(const char* payload, const ObjectMetaData& meta, const PayloadLayout& layout, std::size_t& id)
+	{
+		std::size_t position;
+		if (!getIDPosition(meta, layout, position))
+			return false;
+		std::memcpy(&id, payload + position, sizeof(id));
+		return true;
+	}
+
+	std::size_t Serializer::getRecordHeaderSize(const Settings& settings)
+	{
+		return settings.lengthFramedRecords ? 2 * sizeof(std::size_t) : sizeof(std::size_t);
+	}
+	void Serializer::encodeRecordHeader(char* destination, std::size_t typeHash, std::size_t payloadSize, const Settings& settings)
+	{
+		std::memcpy(destination, &typeHash, sizeof(typeHash));
+		if (settings.lengthFramedRecords)
+			std::memcpy(destination + sizeof(typeHash), &payloadSize, sizeof(payloadSize));
+	}
+	bool Serializer::readRecordHeader(IDataSource& source, RecordHeader& header, const Settings& settings)
+	{
+		header.payloadSize = 0;
+		if (!source.read(reinterpret_cast<char*>(&header.typeHash), sizeof(header.typeHash)))
+			return false; // EOF or read error
+		if (static_cast<std::uint64_t>(header.typeHash) == s_sparseIndexMagic)
+			return false; // End of the records of a sorted file
+		if (settings.lengthFramedRecords &&
+			!source.read(reinterpret_cast<char*>(&header.payloadSize), sizeof(header.payloadSize)))
+			return false;
+		return true;
+	}
+	bool Serializer::skipPayload(IDataSource& source, const RecordHeader& header, const ObjectMetaData* meta, const Settings& settings)
+	{
+		if (settings.lengthFramedRecords)
+			return source.skip(header.payloadSize);
+
+		if (!meta)
+			meta = findTombstoneType(header.typeHash);
+		PayloadLayout layout;
+		if (meta && getPayloadLayout(*meta, settings, layout))
+			return source.skip(layout.size);
+		if (!meta && findReferenceType(header.typeHash))
+			return source.skip(sizeof(std::uint64_t));
+
+		// Without framing the size of unknown records is not known.
+		// Assume maximum size struct and skip it (adjust if known max size is different)
+		source.skip(1024);
+		return true;
+	}
+	bool Serializer::checkPayloadSize(const RecordHeader& header, const ObjectMetaData& meta, const PayloadLayout& layout, const Settings& settings)
+	{
+		if (!settings.lengthFramedRecords || header.payloadSize == layout.size)
+			return true;
+#if LOGGER_LIBRARY_AVAILABLE == 1
+		getLogger().logError("Record of type: " + meta.name + " has " + std::to_string(header.payloadSize) +
+							 " bytes, expected " + std::to_string(layout.size) + ". Record skipped");
+#else
+		OS_UNUSED(meta);
+#endif
+		return false;
+	}
+
+	bool Serializer::scan(IDataSource& source, const std::vector<std::size_t>& types, const RecordPredicate& predicate, std::vector<ISerializable*>& objs, const Settings& settings)
+	{
+		objs.clear();
+		const auto& mataMap = getObjectMetaData();
+		std::size_t nextFreeID = 0;
+
+		RecordHeader header;
+		while (readRecordHeader(source, header, settings))
+		{
+			const auto& it = mataMap.find(header.typeHash);
+			const ObjectMetaData* meta = it != mataMap.end() ? &it->second : nullptr;
+			const bool wanted = meta && (types.empty() || std::find(types.begin(), types.end(), header.typeHash) != types.end());
+			PayloadLayout layout;
+			if (!wanted || !getPayloadLayout(*meta, settings, layout) || !checkPayloadSize(header, *meta, layout, settings))
+			{
+				if (!skipPayload(source, header, meta, settings))
+					break;
+				continue;
+			}
+
+			char* payload = getScratchBuffer(layout.size);
+			if (!source.read(payload, layout.size))
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				getLogger().logError("Truncated object of type: " + meta->name);
+#endif
+				break;
+			}
+			if (predicate && !predicate(header.typeHash, payload, layout.size))
+				continue;
+
+			ISerializable* obj = meta->create();
+			decodePayload(payload, obj, layout);
+			objs.push_back(obj);
+			if (const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj))
+			{
+				if (objWithID->getID() >= nextFreeID)
+					nextFreeID = objWithID->getID() + 1;
+			}
+		}
+		IDAllocator::seed(nextFreeID);
+		return true;
+	}
+	bool Serializer::writeRecords(IDataSink& sink, const ISerializable* const* objs, std::size_t count, std::size_t typeHash, const PayloadLayout& layout, const Settings& settings, WriteContext* context)
+	{
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		// Objects with ID are never duplicates of each other, tiny payloads are cheaper than a reference
+		const bool deduplicate = context && context->deduplicate && layout.size > sizeof(std::uint64_t) &&
+								 !dynamic_cast<const ISerializableID*>(objs[0]);
+		const auto recordWritten = [context](const ISerializable* obj, std::size_t recordSize)
+			{
+				if (!context)
+					return;
+				if (context->sparseIndexInterval != 0)
+				{
+					const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj);
+					if (objWithID && context->indexedCount++ % context->sparseIndexInterval == 0)
+						context->sparseIndex.push_back({ objWithID->getID(), context->offset });
+				}
+				context->offset += recordSize;
+				++context->position;
+			};
+		if (!layout.fields && !layout.pointers && !deduplicate)
+		{
+			char header[2 * sizeof(std::size_t)];
+			encodeRecordHeader(header, typeHash, layout.size, settings);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (!sink.write(header, headerSize) ||
+					!writePayload(sink, objs[i], layout))
+					return false;
+				recordWritten(objs[i], headerSize + layout.size);
+			}
+			return true;
+		}
+
+		// Packed records, records with pointers and deduplicated records get gathered
+		// into one buffer per chunk and written at once
+		const std::size_t recordSize = headerSize + layout.size;
+		const std::size_t recordsPerChunk = std::max<std::size_t>(1, s_bulkChunkSize / recordSize);
+		for (std::size_t chunkStart = 0; chunkStart < count; chunkStart += recordsPerChunk)
+		{
+			const std::size_t chunkCount = std::min(recordsPerChunk, count - chunkStart);
+			char* buffer = getScratchBuffer(chunkCount * recordSize);
+			char* dst = buffer;
+			for (std::size_t i = chunkStart; i < chunkStart + chunkCount; ++i)
+			{
+				char* record = dst;
+				encodeRecordHeader(dst, typeHash, layout.size, settings);
+				dst += headerSize;
+				const char* src = reinterpret_cast<const char*>(objs[i]);
+				if (!layout.fields)
+				{
+					std::memcpy(dst, src + layout.offset, layout.size);
+				}
+				else
+				{
+					char* field = dst;
+					for (const FieldSpan& span : *layout.fields)
+					{
+						std::memcpy(field, src + span.offset, span.size);
+						field += span.size;
+					}
+				}
+				if (layout.pointers)
+					encodePointers(dst, objs[i], layout, context ? &context->pointerTable : nullptr);
+				dst += layout.size;
+
+				std::uint64_t original;
+				if (deduplicate && findDuplicate(*context, typeHash, record + headerSize, layout.size, original))
+				{
+					// The reference replaces the record in the buffer
+					dst = record;
+					encodeRecordHeader(dst, getReferenceHash(typeHash), sizeof(original), settings);
+					dst += headerSize;
+					std::memcpy(dst, &original, sizeof(original));
+					dst += sizeof(original);
+				}
+				recordWritten(objs[i], static_cast<std::size_t>(dst - record));
+			}
+			if (!sink.write(buffer, static_cast<std::size_t>(dst - buffer)))
+				return false;
+		}
+		return true;
+	}
+	void Serializer::sortByID(const std::vector<ISerializable*>& objs, std::vector<ISerializable*>& sorted)
+	{
+		std::vector<const ISerializableID*> objsWithID;
+		sorted.clear();
+		sorted.reserve(objs.size());
+		objsWithID.reserve(objs.size());
+		for (ISerializable* obj : objs)
+		{
+			if (const ISerializableID* objWithID = dynamic_cast<const ISerializableID*>(obj))
+				objsWithID.push_back(objWithID);
+			else
+				sorted.push_back(obj);
+		}
+		std::stable_sort(objsWithID.begin(), objsWithID.end(), [](const ISerializableID* a, const ISerializableID* b)
+			{
+				return a->getID() < b->getID();
+			});
+		for (const ISerializableID* obj : objsWithID)
+			sorted.push_back(const_cast<ISerializableID*>(obj));
+	}
+	bool Serializer::findDuplicate(WriteContext& context, std::size_t typeHash, const char* payload, std::size_t size, std::uint64_t& position)
+	{
+		const std::uint64_t hash = hashPayload(payload, size);
+		const auto& range = context.payloads.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			const StoredPayload& stored = it->second;
+			if (stored.typeHash == typeHash && stored.size == size &&
+				std::memcmp(context.payloadData.data() + stored.dataOffset, payload, size) == 0)
+			{
+				position = stored.position;
+				return true;
+			}
+		}
+		context.payloads.emplace(hash, StoredPayload{ typeHash, context.position, context.payloadData.size(), size });
+		context.payloadData.insert(context.payloadData.end(), payload, payload + size);
+		return false;
+	}
+	bool Serializer::writeSparseIndex(IDataSink& sink, const std::vector<SparseIndexEntry>& entries, std::uint64_t indexOffset)
+	{
+		const std::uint64_t header[2] = { s_sparseIndexMagic, entries.size() };
+		const std::uint64_t footer[2] = { indexOffset, s_sparseIndexMagic };
+		return sink.write(reinterpret_cast<const char*>(header), sizeof(header)) &&
+			   sink.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SparseIndexEntry)) &&
+			   sink.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+	}
+	bool Serializer::isSortedFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		std::uint64_t indexOffset = 0;
+		std::uint64_t indexCount = 0;
+		return file.is_open() && findSparseIndex(file, indexOffset, indexCount);
+	}
+	bool Serializer::findSparseIndex(std::istream& file, std::uint64_t& indexOffset, std::uint64_t& count)
+	{
+		std::uint64_t footer[2];
+		file.clear();
+		file.seekg(0, std::ios::end);
+		const std::uint64_t fileSize = static_cast<std::uint64_t>(file.tellg());
+		if (!file || fileSize < 2 * sizeof(footer))
+			return false;
+		file.seekg(static_cast<std::streamoff>(fileSize - sizeof(footer)), std::ios::beg);
+		if (!file.read(reinterpret_cast<char*>(footer), sizeof(footer)) || footer[1] != s_sparseIndexMagic)
+			return false;
+
+		indexOffset = footer[0];
+		std::uint64_t header[2];
+		if (indexOffset > fileSize - 2 * sizeof(footer))
+			return false;
+		file.seekg(static_cast<std::streamoff>(indexOffset), std::ios::beg);
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != s_sparseIndexMagic ||
+			header[1] != (fileSize - indexOffset - 2 * sizeof(footer)) / sizeof(SparseIndexEntry))
+			return false;
+		count = header[1];
+		return true;
+	}
+	bool Serializer::findSparseStart(std::istream& file, std::size_t id, std::uint64_t& offset)
+	{
+		offset = 0;
+		std::uint64_t indexOffset = 0;
+		std::uint64_t count = 0;
+		if (!findSparseIndex(file, indexOffset, count))
+			return false;
+
+		// Only the probed entries get read from the file
+		const auto readEntry = [&](std::uint64_t index, SparseIndexEntry& entry)
+			{
+				file.seekg(static_cast<std::streamoff>(indexOffset + 2 * sizeof(std::uint64_t) + index * sizeof(SparseIndexEntry)), std::ios::beg);
+				return static_cast<bool>(file.read(reinterpret_cast<char*>(&entry), sizeof(entry)));
+			};
+		// First entry with an ID >= id
+		std::uint64_t low = 0;
+		std::uint64_t high = count;
+		SparseIndexEntry entry;
+		while (low < high)
+		{
+			const std::uint64_t middle = low + (high - low) / 2;
+			if (!readEntry(middle, entry))
+				return false;
+			if (entry.id < id)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		// Equal IDs can start before that entry, start at the one in front of it
+		if (count == 0)
+			offset = indexOffset;
+		else if (!readEntry(low > 0 ? low - 1 : 0, entry))
+			return false;
+		else
+			offset = entry.offset;
+		return true;
+	}
+	bool Serializer::writeArray(IDataSink& sink, std::size_t typeHash, const char* objs, std::size_t stride, std::size_t count, const Settings& settings)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (it == mataMap.end() || !getPayloadLayout(it->second, settings, layout))
+		{
+			typeWithHashNotRegistered(typeHash);
+			return false;
+		}
+		if (layout.pointers)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Arrays of types with pointer members are not supported. Type: " + it->second.name);
+#endif
+			return false;
+		}
+
+		const std::uint64_t header[3] = { typeHash, count, layout.size };
+		if (!sink.write(reinterpret_cast<const char*>(header), sizeof(header)))
+			return false;
+		// Objects without vtable and padding are already in the encoded form
+		if (!layout.fields && layout.offset == 0 && layout.size == stride)
+			return sink.write(objs, count * stride);
+
+		const std::size_t objsPerChunk = std::max<std::size_t>(1, s_bulkChunkSize / std::max<std::size_t>(1, layout.size));
+		for (std::size_t chunkStart = 0; chunkStart < count; chunkStart += objsPerChunk)
+		{
+			const std::size_t chunkCount = std::min(objsPerChunk, count - chunkStart);
+			char* buffer = getScratchBuffer(chunkCount * layout.size);
+			gatherPayloads(buffer, objs + chunkStart * stride, stride, chunkCount, layout);
+			if (!sink.write(buffer, chunkCount * layout.size))
+				return false;
+		}
+		return true;
+	}
+	bool Serializer::readArrayHeader(IDataSource& source, std::size_t typeHash, std::size_t& count, const Settings& settings)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const auto& it = mataMap.find(typeHash);
+		PayloadLayout layout;
+		if (it == mataMap.end() || !getPayloadLayout(it->second, settings, layout))
+		{
+			typeWithHashNotRegistered(typeHash);
+			return false;
+		}
+		if (layout.pointers)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Arrays of types with pointer members are not supported. Type: " + it->second.name);
+#endif
+			return false;
+		}
+
+		std::uint64_t header[3];
+		if (!source.read(reinterpret_cast<char*>(header), sizeof(header)))
+			return false;
+		if (header[0] != typeHash || header[2] != layout.size)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Array block does not match type " + it->second.name);
+#endif
+			return false;
+		}
+		count = static_cast<std::size_t>(header[1]);
+		return true;
+	}
+	bool Serializer::readArray(IDataSource& source, std::size_t typeHash, char* objs, std::size_t stride, std::size_t count, const Settings& settings)
+	{
+		const auto& mataMap = getObjectMetaData();
+		const ObjectMetaData& meta = mataMap.find(typeHash)->second;
+		PayloadLayout layout;
+		getPayloadLayout(meta, settings, layout);
+
+		if (!layout.fields && layout.offset == 0 && layout.size == stride)
+		{
+			if (!source.read(objs, count * stride))
+				return false;
+		}
+		else
+		{
+			const std::size_t objsPerChunk = std::max<std::size_t>(1, s_bulkChunkSize / std::max<std::size_t>(1, layout.size));
+			for (std::size_t chunkStart = 0; chunkStart < count; chunkStart += objsPerChunk)
+			{
+				const std::size_t chunkCount = std::min(objsPerChunk, count - chunkStart);
+				char* buffer = getScratchBuffer(chunkCount * layout.size);
+				if (!source.read(buffer, chunkCount * layout.size))
+					return false;
+				scatterPayloads(objs + chunkStart * stride, buffer, stride, chunkCount, layout);
+			}
+		}
+
+		if (meta.idOffset != s_noID)
+		{
+			std::size_t nextFreeID = 0;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				std::size_t id;
+				std::memcpy(&id, objs + i * stride + meta.idOffset, sizeof(id));
+				nextFreeID = std::max(nextFreeID, id + 1);
+			}
+			IDAllocator::seed(nextFreeID);
+		}
+		return true;
+	}
+	std::mutex& Serializer::getFileMutex(const std::string& filename)
+	{
+		static std::mutex mutexes[64];
+		std::error_code error;
+		const std::filesystem::path path = std::filesystem::absolute(filename, error);
+		const std::string key = error ? filename : path.lexically_normal().string();
+		return mutexes[std::hash<std::string>()(key) % std::size(mutexes)];
+	}
+	std::string Serializer::getTempFilename(const std::string& filename, const std::string& suffix)
+	{
+		// Other processes may write the same file, each gets its own temporary file
+		static std::atomic<std::uint64_t> s_tempFileCount = 0;
+#ifdef _WIN32
+		const std::uint64_t processID = GetCurrentProcessId();
+#else
+		const std::uint64_t processID = static_cast<std::uint64_t>(::getpid());
+#endif
+		return filename + suffix + "." + std::to_string(processID) + "." +
+			std::to_string(s_tempFileCount.fetch_add(1, std::memory_order_relaxed));
+	}
+	bool Serializer::writeFile(const std::string& filename, const std::function<bool(IDataSink&)>& write, const Settings& settings)
+	{
+		std::lock_guard<std::mutex> lock(getFileMutex(filename));
+		const std::string target = settings.atomicSave ? getTempFilename(filename, ".tmp") : filename;
+		SyncFileSink file(target);
+		if (!file.isOpen())
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			getLogger().logError("Failed to open file: " + target);
+#endif
+			return false;
+		}
+
+		bool success = write(file);
+		if (success && settings.syncPolicy != SyncPolicy::None)
+			success = file.sync();
+		file.close();
+
+		std::error_code error;
+		if (settings.atomicSave)
+		{
+			if (success)
+			{
+				std::filesystem::rename(target, filename, error);
+				success = !error;
+			}
+			if (!success)
+				std::filesystem::remove(target, error);
+		}
+		if (success && settings.syncPolicy == SyncPolicy::Full)
+			success = SyncFileSink::syncDirectory(std::filesystem::absolute(filename, error).parent_path().string());
+#if LOGGER_LIBRARY_AVAILABLE == 1
+		if (!success)
+			getLogger().logError("Failed to save file: " + filename);
+#endif
+		return success;
+	}
+	bool Serializer::stageRecords(const std::vector<ISerializable*>& objs, const Settings& settings, std::vector<std::vector<char>>& chunks)
+	{
+		// Pointers, references to duplicates and the sparse index use positions in the whole block
+		const std::size_t threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+		const std::size_t chunkCount = hasPointerMembers(objs) || settings.deduplicatePayloads || settings.sparseIndexInterval != 0 ? 1 :
+			std::clamp<std::size_t>(objs.size() / s_minStageChunkCount, 1, threadCount);
+		const std::size_t headerSize = getRecordHeaderSize(settings);
+		chunks.assign(chunkCount, std::vector<char>());
+
+		const auto stage = [&objs, &settings, &chunks, chunkCount, headerSize](std::size_t chunk)
+			{
+				const std::size_t begin = objs.size() * chunk / chunkCount;
+				const std::size_t end = objs.size() * (chunk + 1) / chunkCount;
+				if (begin == end)
+					return true;
+				chunks[chunk].reserve((end - begin) * (headerSize + getObjectSize(objs[begin])));
+				BufferSink sink(chunks[chunk]);
+				if (chunkCount == 1)
+					return saveTo(sink, objs, settings);
+				return saveTo(sink, std::vector<ISerializable*>(objs.begin() + begin, objs.begin() + end), settings);
+			};
+		std::vector<std::future<bool>> staging;
+		for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+			staging.push_back(std::async(std::launch::async, stage, chunk));
+		bool success = stage(0);
+		for (std::future<bool>& result : staging)
+			success = result.get() && success;
+		return success;
 	}
-	Serializer::VTableMetaData& Serializer::getVTableMetaData()
+	char* Serializer::getScratchBuffer(std::size_t size)
 	{
-		static VTableMetaData vTableMetaData;
-		return vTableMetaData;
+		thread_local std::vector<char> buffer;
+		if (buffer.size() < size)
+			buffer.resize(size);
+		return buffer.data();
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,335 @@
+#include "ShardedStore.h"
+
+#include <filesystem>
+#include <future>
+#include <limits>
+#include <sstream>
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		constexpr const char* s_manifestHeader = "ObjectSerializer shards 1";
+		constexpr const char* s_filterExtension = ".bloom";
+
+		// Runs function(shardIndex) for all shards on separate threads
+		template <typename Function>
+		bool forEachShard(std::size_t shardCount, const Function& function)
+		{
+			std::vector<std::future<bool>> results;
+			results.reserve(shardCount);
+			for (std::size_t i = 0; i < shardCount; ++i)
+				results.push_back(std::async(std::launch::async, function, i));
+			bool success = true;
+			for (auto& result : results)
+				success = result.get() && success;
+			return success;
+		}
+	}
+
+	ShardedStore::ShardedStore(const std::string& manifestFilename)
+		: ShardedStore(manifestFilename, Serializer::Settings())
+	{
+
+	}
+	ShardedStore::ShardedStore(const std::string& manifestFilename, const Serializer::Settings& settings)
+		: m_manifestFilename(manifestFilename)
+		, m_settings(settings)
+		, m_partitioning(Partitioning::Hash)
+		, m_rangeSize(0)
+	{
+
+	}
+	ShardedStore::~ShardedStore()
+	{
+		flush();
+	}
+
+	bool ShardedStore::create(std::size_t shardCount, Partitioning partitioning, std::size_t rangeSize)
+	{
+		if (shardCount == 0 || shardCount > s_maxShardCount || (partitioning == Partitioning::Range && rangeSize == 0))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Invalid shard layout for: " + m_manifestFilename);
+#endif
+			return false;
+		}
+		m_partitioning = partitioning;
+		m_rangeSize = rangeSize;
+		setShardCount(shardCount);
+		for (const std::string& shard : m_shards)
+		{
+			std::ofstream file(shard, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to open file: " + shard);
+#endif
+				return false;
+			}
+		}
+		return writeManifest();
+	}
+	bool ShardedStore::open()
+	{
+		std::ifstream file(m_manifestFilename);
+		std::string header;
+		if (!file.is_open() || !std::getline(file, header) || header != s_manifestHeader)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("File is not a shard manifest: " + m_manifestFilename);
+#endif
+			return false;
+		}
+
+		std::string partitioning;
+		std::size_t shardCount = 0;
+		std::string key;
+		std::size_t rangeSize = 0;
+		file >> key >> partitioning >> key >> rangeSize >> key >> shardCount;
+		// Each shard gets its own thread, a range partitioning divides by the range size
+		if (!file || shardCount == 0 || shardCount > s_maxShardCount || (partitioning != "hash" && partitioning != "range") ||
+			(partitioning == "range" && rangeSize == 0))
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Invalid shard manifest: " + m_manifestFilename);
+#endif
+			return false;
+		}
+		m_partitioning = partitioning == "hash" ? Partitioning::Hash : Partitioning::Range;
+		m_rangeSize = rangeSize;
+		setShardCount(shardCount);
+
+		// Shard names are stored relative to the manifest, one per line, and may contain spaces
+		const std::filesystem::path directory = std::filesystem::path(m_manifestFilename).parent_path();
+		file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		for (std::size_t i = 0; i < shardCount; ++i)
+		{
+			std::string name;
+			if (!std::getline(file, name) || name.empty())
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Invalid shard manifest: " + m_manifestFilename);
+#endif
+				return false;
+			}
+			m_shards[i] = (directory / name).string();
+		}
+
+		return forEachShard(shardCount, [&](std::size_t shard)
+			{
+				std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+				// The filter of a shard written by this class is missing until it was flushed
+				if (m_filters[shard].loadFromFile(m_shards[shard] + s_filterExtension, m_shards[shard]))
+					return true;
+				// A shard without a valid filter is searched for every ID
+				if (!m_filters[shard].build(m_shards[shard], m_settings))
+					return false;
+				saveFilter(shard);
+				return true;
+			});
+	}
+
+	bool ShardedStore::save(const std::vector<ISerializableID*>& objs)
+	{
+		if (m_shards.empty())
+			return false;
+		std::vector<std::vector<ISerializable*>> partitions(m_shards.size());
+		for (ISerializableID* obj : objs)
+		{
+			if (obj)
+				partitions[getShardIndex(obj->getID())].push_back(obj);
+		}
+		return forEachShard(m_shards.size(), [&](std::size_t shard)
+			{
+				std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+				if (!invalidateFilter(shard))
+					return false;
+				m_filters[shard].reset(partitions[shard].size());
+				for (ISerializable* obj : partitions[shard])
+					m_filters[shard].insert(static_cast<ISerializableID*>(obj)->getID());
+				if (!Serializer::saveToFile(m_shards[shard], partitions[shard], m_settings))
+					return false;
+				return saveFilter(shard);
+			});
+	}
+	bool ShardedStore::load(std::vector<ISerializable*>& objs) const
+	{
+		objs.clear();
+		std::vector<std::vector<ISerializable*>> partitions(m_shards.size());
+		bool success = forEachShard(m_shards.size(), [&](std::size_t shard)
+			{
+				std::shared_lock<std::shared_mutex> lock(m_shardMutexes[shard]);
+				return Serializer::loadFromFile(m_shards[shard], partitions[shard], m_settings);
+			});
+		std::size_t count = 0;
+		for (const auto& partition : partitions)
+			count += partition.size();
+		objs.reserve(count);
+		for (const auto& partition : partitions)
+			objs.insert(objs.end(), partition.begin(), partition.end());
+		return success;
+	}
+
+	bool ShardedStore::loadFromFile(std::size_t objectID, ISerializableID*& obj) const
+	{
+		obj = nullptr;
+		if (m_shards.empty())
+			return false;
+		const std::size_t shard = getShardIndex(objectID);
+		std::shared_lock<std::shared_mutex> lock(m_shardMutexes[shard]);
+		if (!m_filters[shard].mightContain(objectID))
+			return false;
+		return Serializer::loadFromFile(m_shards[shard], objectID, obj, m_settings);
+	}
+	bool ShardedStore::loadFromFile(std::span<const std::size_t> objectIDs, std::vector<ISerializableID*>& objs) const
+	{
+		objs.assign(objectIDs.size(), nullptr);
+		std::vector<std::vector<std::size_t>> shardIDs(m_shards.size());
+		std::vector<std::vector<std::size_t>> shardPositions(m_shards.size());
+		for (std::size_t i = 0; i < objectIDs.size(); ++i)
+		{
+			const std::size_t shard = getShardIndex(objectIDs[i]);
+			shardIDs[shard].push_back(objectIDs[i]);
+			shardPositions[shard].push_back(i);
+		}
+		return forEachShard(m_shards.size(), [&](std::size_t shard)
+			{
+				std::shared_lock<std::shared_mutex> lock(m_shardMutexes[shard]);
+				// Only the IDs the filter might contain get looked up
+				std::size_t candidates = 0;
+				for (std::size_t i = 0; i < shardIDs[shard].size(); ++i)
+				{
+					if (!m_filters[shard].mightContain(shardIDs[shard][i]))
+						continue;
+					shardIDs[shard][candidates] = shardIDs[shard][i];
+					shardPositions[shard][candidates++] = shardPositions[shard][i];
+				}
+				shardIDs[shard].resize(candidates);
+				if (shardIDs[shard].empty())
+					return true;
+				std::vector<ISerializableID*> found;
+				bool success = Serializer::loadFromFile(m_shards[shard], shardIDs[shard], found, m_settings);
+				// Each thread writes different positions of objs
+				for (std::size_t i = 0; i < found.size(); ++i)
+					objs[shardPositions[shard][i]] = found[i];
+				return success;
+			});
+	}
+	bool ShardedStore::overrideInFile(const ISerializableID* obj)
+	{
+		if (!obj || m_shards.empty())
+			return false;
+		const std::size_t shard = getShardIndex(obj->getID());
+		std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+		return invalidateFilter(shard) && Serializer::overrideInFile(m_shards[shard], obj, m_settings);
+	}
+	bool ShardedStore::addToFile(const ISerializableID* obj)
+	{
+		if (!obj || m_shards.empty())
+			return false;
+		const std::size_t shard = getShardIndex(obj->getID());
+		std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+		if (!invalidateFilter(shard) || !Serializer::addToFile(m_shards[shard], obj, m_settings))
+			return false;
+		m_filters[shard].insert(obj->getID());
+		return true;
+	}
+	bool ShardedStore::removeFromFile(std::size_t objectID)
+	{
+		if (m_shards.empty())
+			return false;
+		const std::size_t shard = getShardIndex(objectID);
+		std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+		// IDs can not be removed from the filter, the removed ID stays a false positive
+		return invalidateFilter(shard) && Serializer::removeFromFile(m_shards[shard], objectID, m_settings);
+	}
+	bool ShardedStore::flush()
+	{
+		bool success = true;
+		for (std::size_t shard = 0; shard < m_shards.size(); ++shard)
+		{
+			std::lock_guard<std::shared_mutex> lock(m_shardMutexes[shard]);
+			if (m_staleFilters[shard])
+				success = saveFilter(shard) && success;
+		}
+		return success;
+	}
+
+	std::size_t ShardedStore::getShardIndex(std::size_t objectID) const
+	{
+		if (m_partitioning == Partitioning::Range)
+			return std::min(objectID / m_rangeSize, m_shards.size() - 1);
+
+		// splitmix64 finalizer, sequential IDs end up in different shards
+		std::uint64_t hash = objectID;
+		hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+		hash = hash ^ (hash >> 31);
+		return static_cast<std::size_t>(hash % m_shards.size());
+	}
+
+	bool ShardedStore::writeManifest() const
+	{
+		std::ostringstream manifest;
+		manifest << s_manifestHeader << "\n";
+		manifest << "partitioning " << (m_partitioning == Partitioning::Hash ? "hash" : "range") << "\n";
+		manifest << "rangeSize " << m_rangeSize << "\n";
+		manifest << "shards " << m_shards.size() << "\n";
+		for (const std::string& shard : m_shards)
+			manifest << std::filesystem::path(shard).filename().string() << "\n";
+		const std::string content = manifest.str();
+
+		// Replace the manifest atomically, it must always describe a complete shard set
+		const std::string tempFilename = m_manifestFilename + ".tmp";
+		{
+			SyncFileSink file(tempFilename);
+			if (!file.isOpen() || !file.write(content.data(), content.size()) ||
+				(m_settings.syncPolicy != Serializer::SyncPolicy::None && !file.sync()))
+			{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+				Serializer::getLogger().logError("Failed to write manifest: " + m_manifestFilename);
+#endif
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tempFilename, m_manifestFilename, error);
+		return !error;
+	}
+	void ShardedStore::setShardCount(std::size_t shardCount)
+	{
+		m_shards.resize(shardCount);
+		for (std::size_t i = 0; i < shardCount; ++i)
+			m_shards[i] = m_manifestFilename + "." + std::to_string(i);
+		m_shardMutexes = std::make_unique<std::shared_mutex[]>(shardCount);
+		m_filters.assign(shardCount, BloomFilter());
+		m_staleFilters.assign(shardCount, 0);
+	}
+	bool ShardedStore::saveFilter(std::size_t shard)
+	{
+		// The filter stays valid while only this class writes the shard, the stored
+		// size and time catch most writes of others without reading the shard
+		if (!m_filters[shard].saveToFile(m_shards[shard] + s_filterExtension, m_shards[shard], false))
+			return false;
+		m_staleFilters[shard] = 0;
+		return true;
+	}
+	bool ShardedStore::invalidateFilter(std::size_t shard)
+	{
+		if (m_staleFilters[shard])
+			return true;
+		// A crash before the next flush leaves the shard without a filter, open() rebuilds it then
+		std::error_code error;
+		std::filesystem::remove(m_shards[shard] + s_filterExtension, error);
+		if (error)
+		{
+#if LOGGER_LIBRARY_AVAILABLE == 1
+			Serializer::getLogger().logError("Failed to remove file: " + m_shards[shard] + s_filterExtension);
+#endif
+			return false;
+		}
+		m_staleFilters[shard] = 1;
+		return true;
+	}
+}
@@ -0,0 +1,307 @@
+#include "SharedMemory.h"
+
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// "OSSHM01" in little endian
+		constexpr std::uint64_t s_sharedMemoryMagic = 0x0031304D4853534FULL;
+
+#ifndef _WIN32
+		// POSIX names start with a single slash
+		std::string getPosixName(const std::string& name)
+		{
+			return !name.empty() && name[0] == '/' ? name : "/" + name;
+		}
+#endif
+	}
+
+	SharedMemorySegment::SharedMemorySegment()
+		: m_header(nullptr)
+		, m_data(nullptr)
+		, m_mappingSize(0)
+#ifdef _WIN32
+		, m_handle(nullptr)
+#else
+		, m_fd(-1)
+#endif
+	{
+
+	}
+	SharedMemorySegment::~SharedMemorySegment()
+	{
+		close();
+	}
+
+	bool SharedMemorySegment::create(const std::string& name, std::size_t capacity)
+	{
+		close();
+		const std::size_t mappingSize = sizeof(Header) + capacity;
+#ifdef _WIN32
+		m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+									  static_cast<DWORD>(static_cast<std::uint64_t>(mappingSize) >> 32),
+									  static_cast<DWORD>(mappingSize), name.c_str());
+		if (!m_handle)
+			return false;
+		// An existing mapping keeps its size
+		if (!map(0, true))
+		{
+			close();
+			return false;
+		}
+#else
+		m_fd = ::shm_open(getPosixName(name).c_str(), O_RDWR | O_CREAT, 0644);
+		struct stat info;
+		if (m_fd < 0 || ::fstat(m_fd, &info) != 0)
+		{
+			close();
+			return false;
+		}
+		// Existing segments only grow, processes which mapped them keep their size
+		std::size_t size = static_cast<std::size_t>(info.st_size);
+		if (size < mappingSize)
+		{
+			if (::ftruncate(m_fd, static_cast<off_t>(mappingSize)) != 0)
+			{
+				close();
+				return false;
+			}
+			size = mappingSize;
+		}
+		if (!map(size, true))
+		{
+			close();
+			return false;
+		}
+#endif
+		if (m_mappingSize < mappingSize)
+		{
+			close();
+			return false;
+		}
+		if (m_header->magic != s_sharedMemoryMagic)
+		{
+			new (m_header) Header();
+			m_header->magic = s_sharedMemoryMagic;
+		}
+		m_header->capacity = m_mappingSize - sizeof(Header);
+		return true;
+	}
+	bool SharedMemorySegment::open(const std::string& name)
+	{
+		close();
+#ifdef _WIN32
+		m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		if (!m_handle || !map(0, false))
+		{
+			close();
+			return false;
+		}
+#else
+		m_fd = ::shm_open(getPosixName(name).c_str(), O_RDONLY, 0);
+		struct stat info;
+		if (m_fd < 0 || ::fstat(m_fd, &info) != 0 ||
+			static_cast<std::size_t>(info.st_size) < sizeof(Header) ||
+			!map(static_cast<std::size_t>(info.st_size), false))
+		{
+			close();
+			return false;
+		}
+#endif
+		if (m_header->magic != s_sharedMemoryMagic)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+	bool SharedMemorySegment::remove(const std::string& name)
+	{
+#ifdef _WIN32
+		OS_UNUSED(name);
+		return true;
+#else
+		return ::shm_unlink(getPosixName(name).c_str()) == 0;
+#endif
+	}
+
+#ifdef _WIN32
+	bool SharedMemorySegment::map(std::size_t mappingSize, bool writable)
+	{
+		void* view = MapViewOfFile(m_handle, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, mappingSize);
+		if (!view)
+			return false;
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(view, &info, sizeof(info)) == 0 || info.RegionSize < sizeof(Header))
+		{
+			UnmapViewOfFile(view);
+			return false;
+		}
+		m_header = static_cast<Header*>(view);
+		m_data = static_cast<char*>(view) + sizeof(Header);
+		m_mappingSize = info.RegionSize;
+		return true;
+	}
+	void SharedMemorySegment::close()
+	{
+		if (m_header)
+			UnmapViewOfFile(m_header);
+		if (m_handle)
+			CloseHandle(m_handle);
+		m_header = nullptr;
+		m_data = nullptr;
+		m_mappingSize = 0;
+		m_handle = nullptr;
+	}
+#else
+	bool SharedMemorySegment::map(std::size_t mappingSize, bool writable)
+	{
+		void* view = ::mmap(nullptr, mappingSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+		if (view == MAP_FAILED)
+			return false;
+		m_header = static_cast<Header*>(view);
+		m_data = static_cast<char*>(view) + sizeof(Header);
+		m_mappingSize = mappingSize;
+		return true;
+	}
+	void SharedMemorySegment::close()
+	{
+		if (m_header)
+			::munmap(m_header, m_mappingSize);
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_header = nullptr;
+		m_data = nullptr;
+		m_mappingSize = 0;
+		m_fd = -1;
+	}
+#endif
+
+
+	SharedMemorySink::SharedMemorySink(const std::string& name, std::size_t capacity)
+		: m_position(0)
+		, m_writing(false)
+		, m_failed(false)
+	{
+		m_segment.create(name, capacity);
+	}
+
+	void SharedMemorySink::begin()
+	{
+		m_position = 0;
+		m_failed = !m_segment.isOpen();
+		m_writing = !m_failed;
+		if (!m_writing)
+			return;
+		// Odd generation: readers discard what they read from now on.
+		// A writer which died during a snapshot left it odd already.
+		SharedMemorySegment::Header* header = m_segment.getHeader();
+		const std::uint64_t generation = header->generation.load(std::memory_order_relaxed);
+		header->generation.store(generation | 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	bool SharedMemorySink::write(const char* data, std::size_t size)
+	{
+		if (!m_writing || size > m_segment.getCapacity() - m_position)
+		{
+			m_failed = true;
+			return false;
+		}
+		std::memcpy(m_segment.getData() + m_position, data, size);
+		m_position += size;
+		return true;
+	}
+	bool SharedMemorySink::commit()
+	{
+		if (!m_writing)
+			return false;
+		m_writing = false;
+		SharedMemorySegment::Header* header = m_segment.getHeader();
+		// A failed snapshot is published empty, readers must not decode a part of it
+		header->size.store(m_failed ? 0 : m_position, std::memory_order_relaxed);
+		header->generation.store(header->generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return !m_failed;
+	}
+
+	std::uint64_t SharedMemorySink::getGeneration() const
+	{
+		return m_segment.isOpen() ? m_segment.getHeader()->generation.load(std::memory_order_relaxed) : 0;
+	}
+
+
+	SharedMemorySource::SharedMemorySource(const std::string& name)
+		: m_generation(0)
+		, m_size(0)
+		, m_position(0)
+	{
+		m_segment.open(name);
+	}
+
+	bool SharedMemorySource::beginRead()
+	{
+		m_size = 0;
+		m_position = 0;
+		if (!m_segment.isOpen())
+			return false;
+		const SharedMemorySegment::Header* header = m_segment.getHeader();
+		m_generation = header->generation.load(std::memory_order_acquire);
+		if (m_generation == 0 || (m_generation & 1))
+			return false;
+		const std::size_t size = static_cast<std::size_t>(header->size.load(std::memory_order_relaxed));
+		// The segment grew after it was mapped here
+		if (size > m_segment.getCapacity())
+			return false;
+		m_size = size;
+		return true;
+	}
+	bool SharedMemorySource::endRead() const
+	{
+		if (!m_segment.isOpen() || m_generation == 0 || (m_generation & 1))
+			return false;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return m_segment.getHeader()->generation.load(std::memory_order_relaxed) == m_generation;
+	}
+	bool SharedMemorySource::hasUpdate() const
+	{
+		if (!m_segment.isOpen())
+			return false;
+		const std::uint64_t generation = m_segment.getHeader()->generation.load(std::memory_order_acquire);
+		return !(generation & 1) && generation != m_generation;
+	}
+
+	bool SharedMemorySource::read(char* data, std::size_t size)
+	{
+		if (size > m_size - m_position)
+		{
+			m_position = m_size;
+			return false;
+		}
+		std::memcpy(data, m_segment.getData() + m_position, size);
+		m_position += size;
+		return true;
+	}
+	bool SharedMemorySource::skip(std::size_t size)
+	{
+		if (size > m_size - m_position)
+		{
+			m_position = m_size;
+			return false;
+		}
+		m_position += size;
+		return true;
+	}
+}
@@ -0,0 +1,225 @@
+#include "Serializer.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OBJECT_SERIALIZER_X86_KERNELS
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// MSVC allows intrinsics of all instruction sets in every function,
+// gcc and clang need them to be enabled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define OBJECT_SERIALIZER_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+#define OBJECT_SERIALIZER_TARGET(instructionSet)
+#endif
+
+namespace ObjectSerializer
+{
+	namespace
+	{
+		// Copies count payloads of size bytes, srcStride bytes apart, to dstStride bytes apart.
+		// Kernels may store up to one vector behind a payload if dst and src have enough room.
+		// The bytes behind each payload in dst (the vtable pointer of the objects) get restored
+		// from gap afterwards.
+		struct StridedCopy
+		{
+			char* dst;
+			std::size_t dstStride;
+			const char* dstEnd;
+			const char* src;
+			std::size_t srcStride;
+			const char* srcEnd;
+			std::size_t size;
+			std::size_t count;
+			const char* gap;
+			std::size_t gapSize;
+		};
+		using StridedCopyFunction = void(*)(const StridedCopy& copy);
+
+		inline bool hasRoom(const char* position, const char* end, std::size_t size)
+		{
+			return static_cast<std::size_t>(end - position) >= size;
+		}
+		inline void restoreGap(const StridedCopy& copy, char* dst)
+		{
+			char* gapStart = dst + copy.size;
+			std::size_t gapSize = std::min<std::size_t>(copy.gapSize, static_cast<std::size_t>(copy.dstEnd - gapStart));
+			std::memcpy(gapStart, copy.gap, gapSize);
+		}
+
+		void copyScalar(const StridedCopy& copy)
+		{
+			char* dst = copy.dst;
+			const char* src = copy.src;
+			for (std::size_t i = 0; i < copy.count; ++i, dst += copy.dstStride, src += copy.srcStride)
+				std::memcpy(dst, src, copy.size);
+		}
+
+#ifdef OBJECT_SERIALIZER_X86_KERNELS
+		OBJECT_SERIALIZER_TARGET("sse2")
+		void copySSE2(const StridedCopy& copy)
+		{
+			char* dst = copy.dst;
+			const char* src = copy.src;
+			const std::size_t size = copy.size;
+			for (std::size_t i = 0; i < copy.count; ++i, dst += copy.dstStride, src += copy.srcStride)
+			{
+				if (size >= 16)
+				{
+					std::size_t pos = 0;
+					for (; pos + 16 <= size; pos += 16)
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos)));
+					// Overlapping last vector instead of a byte wise tail
+					if (pos < size)
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size - 16), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 16)));
+					continue;
+				}
+				if (hasRoom(dst, copy.dstEnd, 16) && hasRoom(src, copy.srcEnd, 16))
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+				else
+					std::memcpy(dst, src, size);
+				if (copy.gapSize)
+					restoreGap(copy, dst);
+			}
+		}
+
+		OBJECT_SERIALIZER_TARGET("avx2")
+		void copyAVX2(const StridedCopy& copy)
+		{
+			char* dst = copy.dst;
+			const char* src = copy.src;
+			const std::size_t size = copy.size;
+			for (std::size_t i = 0; i < copy.count; ++i, dst += copy.dstStride, src += copy.srcStride)
+			{
+				if (size >= 32)
+				{
+					std::size_t pos = 0;
+					for (; pos + 32 <= size; pos += 32)
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + pos), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + pos)));
+					if (pos < size)
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + size - 32), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + size - 32)));
+					continue;
+				}
+				if (size >= 16)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size - 16), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size - 16)));
+					continue;
+				}
+				if (hasRoom(dst, copy.dstEnd, 16) && hasRoom(src, copy.srcEnd, 16))
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+				else
+					std::memcpy(dst, src, size);
+				if (copy.gapSize)
+					restoreGap(copy, dst);
+			}
+			_mm256_zeroupper();
+		}
+
+		bool cpuSupportsAVX2()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			// The OS must save the ymm registers on context switches
+			if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+		bool cpuSupportsSSE2()
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			return true;
+#elif defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 26)) != 0;
+#else
+			return __builtin_cpu_supports("sse2");
+#endif
+		}
+#endif
+
+		StridedCopyFunction selectKernel()
+		{
+#ifdef OBJECT_SERIALIZER_X86_KERNELS
+			if (cpuSupportsAVX2())
+				return &copyAVX2;
+			if (cpuSupportsSSE2())
+				return &copySSE2;
+#endif
+			return &copyScalar;
+		}
+		StridedCopyFunction getKernel()
+		{
+			static const StridedCopyFunction kernel = selectKernel();
+			return kernel;
+		}
+	}
+
+	void Serializer::gatherPayloads(char* destination, const char* objs, std::size_t stride, std::size_t count, const PayloadLayout& layout)
+	{
+		if (!layout.fields)
+		{
+			// The spill behind each payload lands in the slot of the next payload,
+			// which gets written afterwards
+			StridedCopy copy{ destination, layout.size, destination + count * layout.size,
+							  objs + layout.offset, stride, objs + count * stride,
+							  layout.size, count, nullptr, 0 };
+			getKernel()(copy);
+			return;
+		}
+		for (std::size_t i = 0; i < count; ++i, objs += stride)
+		{
+			for (const FieldSpan& field : *layout.fields)
+			{
+				std::memcpy(destination, objs + field.offset, field.size);
+				destination += field.size;
+			}
+		}
+	}
+	void Serializer::scatterPayloads(char* objs, const char* source, std::size_t stride, std::size_t count, const PayloadLayout& layout)
+	{
+		if (!layout.fields)
+		{
+			if (count == 0)
+				return;
+			// All objects are of the same type, so the bytes between two payloads
+			// (the vtable pointer) are the same for all of them. They get re-stamped
+			// after each payload that was written with a spilling store.
+			const std::size_t gapSize = stride - layout.size;
+			const std::size_t tailSize = stride - layout.offset - layout.size;
+			std::vector<char> gapBytes(gapSize);
+			std::memcpy(gapBytes.data(), objs + layout.offset + layout.size, tailSize);
+			std::memcpy(gapBytes.data() + tailSize, objs, layout.offset);
+			StridedCopy copy{ objs + layout.offset, stride, objs + count * stride,
+							  source, layout.size, source + count * layout.size,
+							  layout.size, count, gapBytes.data(), gapSize };
+			getKernel()(copy);
+			return;
+		}
+		for (std::size_t i = 0; i < count; ++i, objs += stride)
+		{
+			for (const FieldSpan& field : *layout.fields)
+			{
+				std::memcpy(objs + field.offset, source, field.size);
+				source += field.size;
+			}
+		}
+	}
+}
@@ -55,6 +55,8 @@ int main(int argc, char* argv[])
     // Register deserialization handlers for each type
     ObjectSerializer::Serializer::registerType<ExampleStruct>();
     ObjectSerializer::Serializer::registerType<AnotherStruct>();
+    // Optional: only these members get written, without padding bytes
+    ObjectSerializer::Serializer::registerMembers<ExampleStruct>(&ExampleStruct::text, &ExampleStruct::b);
 
     ObjectSerializer::Profiler::start();
     ObjectSerializer::LibraryInfo::printInfo();
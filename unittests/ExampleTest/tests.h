@@ -2,4 +2,8 @@
 
 #include "test.h"
 #include "tests/TST_simple.h"
+#include "tests/TST_IDAllocator.h"
+#include "tests/TST_Serializer.h"
+#include "tests/TST_ColumnStore.h"
+#include "tests/TST_IDStore.h"
 //#include "test_nasted.h"
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "ObjectSerializer.h"
+
+namespace TST_ColumnStoreTypes
+{
+	struct Sample : public ObjectSerializer::ISerializableID
+	{
+		float value = 0;
+		int counter = 0;
+		char flag = 0;
+	};
+	struct Other : public ObjectSerializer::ISerializable
+	{
+		double weight = 0;
+	};
+}
+
+class TST_ColumnStore : public UnitTest::Test
+{
+	TEST_CLASS(TST_ColumnStore)
+public:
+	TST_ColumnStore()
+		: Test("TST_ColumnStore")
+	{
+		ADD_TEST(TST_ColumnStore::projection);
+		ADD_TEST(TST_ColumnStore::reconstruct);
+		ADD_TEST(TST_ColumnStore::corruptHeader);
+
+	}
+
+private:
+	const std::string m_filename = "TST_ColumnStore.bin";
+	std::vector<TST_ColumnStoreTypes::Sample> m_samples;
+	std::vector<TST_ColumnStoreTypes::Other> m_others;
+
+	bool save()
+	{
+		using namespace TST_ColumnStoreTypes;
+		ObjectSerializer::Serializer::registerMembers<Sample>(&Sample::value, &Sample::counter, &Sample::flag);
+		ObjectSerializer::Serializer::registerMembers<Other>(&Other::weight);
+
+		m_samples.resize(1000);
+		m_others.resize(10);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < m_samples.size(); ++i)
+		{
+			m_samples[i].value = static_cast<float>(i) * 0.25f;
+			m_samples[i].counter = static_cast<int>(i);
+			m_samples[i].flag = static_cast<char>(i % 2);
+			objs.push_back(&m_samples[i]);
+			if (i % 100 == 0)
+			{
+				m_others[i / 100].weight = static_cast<double>(i);
+				objs.push_back(&m_others[i / 100]);
+			}
+		}
+		return ObjectSerializer::ColumnStore::saveToFile(m_filename, objs);
+	}
+
+	// Tests
+	TEST_FUNCTION(projection)
+	{
+		TEST_START;
+		using namespace TST_ColumnStoreTypes;
+		TEST_ASSERT(save());
+
+		std::size_t count = 0;
+		TEST_ASSERT(ObjectSerializer::ColumnStore::getObjectCount<Sample>(m_filename, count));
+		TEST_COMPARE(count, m_samples.size());
+
+		std::vector<float> values;
+		TEST_ASSERT(ObjectSerializer::ColumnStore::loadColumn(m_filename, &Sample::value, values));
+		TEST_COMPARE(values.size(), m_samples.size());
+		for (std::size_t i = 0; i < values.size(); ++i)
+			TEST_COMPARE(values[i], m_samples[i].value);
+
+		std::vector<double> weights;
+		TEST_ASSERT(ObjectSerializer::ColumnStore::loadColumn(m_filename, &Other::weight, weights));
+		TEST_COMPARE(weights.size(), m_others.size());
+		TEST_COMPARE(weights[3], 300.0);
+	}
+
+
+
+
+	TEST_FUNCTION(reconstruct)
+	{
+		TEST_START;
+		using namespace TST_ColumnStoreTypes;
+		TEST_ASSERT(save());
+
+		std::vector<Sample> loaded;
+		TEST_ASSERT(ObjectSerializer::ColumnStore::loadObjects(m_filename, loaded, 500, 20));
+		TEST_COMPARE(loaded.size(), std::size_t(20));
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+		{
+			const Sample& expected = m_samples[500 + i];
+			TEST_COMPARE(loaded[i].getID(), expected.getID());
+			TEST_COMPARE(loaded[i].value, expected.value);
+			TEST_COMPARE(loaded[i].counter, expected.counter);
+			TEST_COMPARE(loaded[i].flag, expected.flag);
+		}
+
+		// New objects get IDs above the loaded ones
+		m_samples.back().setID(ObjectSerializer::IDAllocator::getNextFreeID() + 1000);
+		TEST_ASSERT(save());
+		TEST_ASSERT(ObjectSerializer::ColumnStore::loadObjects(m_filename, loaded, m_samples.size() - 1));
+		TEST_COMPARE(loaded.size(), std::size_t(1));
+		TEST_COMPARE(loaded[0].getID(), m_samples.back().getID());
+		Sample created;
+		TEST_ASSERT(created.getID() > loaded[0].getID());
+	}
+
+	TEST_FUNCTION(corruptHeader)
+	{
+		TEST_START;
+		using namespace TST_ColumnStoreTypes;
+		TEST_ASSERT(save());
+
+		// A huge type count in a short file fails instead of allocating
+		const std::uint64_t typeCount = 1ULL << 60;
+		{
+			std::fstream file(m_filename, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(sizeof(std::uint64_t));
+			file.write(reinterpret_cast<const char*>(&typeCount), sizeof(typeCount));
+		}
+		std::size_t count = 0;
+		TEST_ASSERT(!ObjectSerializer::ColumnStore::getObjectCount<Sample>(m_filename, count));
+		std::vector<Sample> loaded;
+		TEST_ASSERT(!ObjectSerializer::ColumnStore::loadObjects(m_filename, loaded));
+	}
+
+};
+
+TEST_INSTANTIATE(TST_ColumnStore);
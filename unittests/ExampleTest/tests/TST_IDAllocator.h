@@ -0,0 +1,73 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "ObjectSerializer.h"
+
+#include <thread>
+#include <unordered_set>
+
+class TST_IDAllocator : public UnitTest::Test
+{
+	TEST_CLASS(TST_IDAllocator)
+public:
+	TST_IDAllocator()
+		: Test("TST_IDAllocator")
+	{
+		ADD_TEST(TST_IDAllocator::uniqueAcrossThreads);
+		ADD_TEST(TST_IDAllocator::seed);
+
+	}
+
+private:
+
+	// Tests
+	TEST_FUNCTION(uniqueAcrossThreads)
+	{
+		TEST_START;
+
+		const std::size_t threadCount = 8;
+		const std::size_t idsPerThread = 10000;
+		std::vector<std::vector<std::size_t>> ids(threadCount);
+		std::vector<std::thread> threads;
+		for (std::size_t i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back([&ids, i, idsPerThread]()
+				{
+					ids[i].reserve(idsPerThread);
+					for (std::size_t j = 0; j < idsPerThread; ++j)
+						ids[i].push_back(ObjectSerializer::IDAllocator::allocate());
+				});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		std::unordered_set<std::size_t> unique;
+		for (const auto& list : ids)
+			unique.insert(list.begin(), list.end());
+		TEST_COMPARE(unique.size(), threadCount * idsPerThread);
+	}
+
+
+
+
+	TEST_FUNCTION(seed)
+	{
+		TEST_START;
+
+		std::size_t seedID = ObjectSerializer::IDAllocator::getNextFreeID() + 1000;
+		ObjectSerializer::IDAllocator::seed(seedID);
+		TEST_ASSERT(ObjectSerializer::IDAllocator::allocate() >= seedID);
+
+		// Seeding below the current counter must not move it backwards
+		ObjectSerializer::IDAllocator::seed(0);
+		const std::size_t id = ObjectSerializer::IDAllocator::allocate();
+		TEST_ASSERT(id >= seedID);
+
+		// Seeding with handed out IDs keeps the block of the thread
+		ObjectSerializer::IDAllocator::seed(id);
+		TEST_COMPARE(ObjectSerializer::IDAllocator::allocate(), id + 1);
+	}
+
+};
+
+TEST_INSTANTIATE(TST_IDAllocator);
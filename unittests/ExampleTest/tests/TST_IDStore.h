@@ -0,0 +1,642 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "ObjectSerializer.h"
+
+#include <filesystem>
+#include <thread>
+
+namespace TST_IDStoreTypes
+{
+	struct Entity : public ObjectSerializer::ISerializableID
+	{
+		int health = 100;
+		float position[3] = { 0, 0, 0 };
+	};
+	struct Marker : public ObjectSerializer::ISerializableID
+	{
+		char name[8] = "marker";
+	};
+
+	// Saves count entities with a marker after every 10th entity
+	inline bool createStore(const std::string& filename, std::vector<Entity>& entities, std::vector<Marker>& markers, std::size_t count = 200)
+	{
+		ObjectSerializer::Serializer::registerType<Entity>();
+		ObjectSerializer::Serializer::registerType<Marker>();
+		entities.clear();
+		markers.clear();
+		entities.resize(count);
+		markers.resize(count / 10);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			entities[i].health = static_cast<int>(i);
+			objs.push_back(&entities[i]);
+			if (i % 10 == 9)
+				objs.push_back(&markers[i / 10]);
+		}
+		ObjectSerializer::Serializer serializer;
+		for (auto obj : objs)
+			serializer.addObject(obj);
+		return serializer.saveToFile(filename);
+	}
+}
+
+class TST_IDStore : public UnitTest::Test
+{
+	TEST_CLASS(TST_IDStore)
+public:
+	TST_IDStore()
+		: Test("TST_IDStore")
+	{
+		ADD_TEST(TST_IDStore::objectCache);
+		ADD_TEST(TST_IDStore::multiGet);
+		ADD_TEST(TST_IDStore::loadAllOfType);
+		ADD_TEST(TST_IDStore::removeAndCompact);
+		ADD_TEST(TST_IDStore::journal);
+		ADD_TEST(TST_IDStore::shardedStore);
+		ADD_TEST(TST_IDStore::bloomFilter);
+		ADD_TEST(TST_IDStore::sortedRange);
+		ADD_TEST(TST_IDStore::lazyRef);
+
+	}
+
+private:
+
+	// Tests
+	TEST_FUNCTION(objectCache)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_cache.bin";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+
+		// Room for two entities
+		ObjectSerializer::ObjectCache cache(2 * sizeof(Entity));
+		auto first = cache.get(filename, entities[5].getID());
+		TEST_ASSERT(first != nullptr);
+		TEST_COMPARE(dynamic_cast<const Entity*>(first.get())->health, 5);
+		TEST_ASSERT(cache.get(filename, entities[5].getID()) == first);
+		TEST_COMPARE(cache.getHitCount(), std::size_t(1));
+
+		cache.get(filename, entities[6].getID());
+		cache.get(filename, entities[7].getID());
+		TEST_COMPARE(cache.getMemoryUsage(), 2 * sizeof(Entity));
+		// entities[5] was the least recently used one and got evicted
+		TEST_ASSERT(cache.get(filename, entities[5].getID()) != first);
+		TEST_COMPARE(dynamic_cast<const Entity*>(first.get())->health, 5);
+
+		Entity changed = entities[7];
+		changed.health = -1;
+		TEST_ASSERT(cache.overrideInFile(filename, &changed));
+		auto reloaded = cache.get(filename, changed.getID());
+		TEST_COMPARE(dynamic_cast<const Entity*>(reloaded.get())->health, -1);
+
+		TEST_ASSERT(cache.get(filename, static_cast<std::size_t>(-5)) == nullptr);
+	}
+
+	TEST_FUNCTION(multiGet)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_multiGet.bin";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+
+		const std::vector<std::size_t> ids = { entities[150].getID(), markers[3].getID(), static_cast<std::size_t>(-5), entities[2].getID(), entities[3].getID() };
+		auto check = [&](const std::vector<ObjectSerializer::ISerializableID*>& objs)
+		{
+			TEST_COMPARE(objs.size(), ids.size());
+			TEST_COMPARE(dynamic_cast<Entity*>(objs[0])->health, 150);
+			TEST_ASSERT(dynamic_cast<Marker*>(objs[1]) != nullptr);
+			TEST_ASSERT(objs[2] == nullptr);
+			TEST_COMPARE(dynamic_cast<Entity*>(objs[3])->health, 2);
+			TEST_COMPARE(dynamic_cast<Entity*>(objs[4])->health, 3);
+			for (std::size_t i = 0; i < objs.size(); ++i)
+			{
+				if (objs[i])
+					TEST_COMPARE(objs[i]->getID(), ids[i]);
+				delete objs[i];
+			}
+		};
+
+		ObjectSerializer::Serializer serializer;
+		std::vector<ObjectSerializer::ISerializableID*> objs;
+		TEST_ASSERT(serializer.loadFromFile(filename, ids, objs));
+		check(objs);
+
+		ObjectSerializer::FileIndex index;
+		TEST_ASSERT(index.build(filename));
+		TEST_COMPARE(index.size(), entities.size() + markers.size());
+		TEST_ASSERT(serializer.loadFromFile(filename, index, ids, objs));
+		check(objs);
+	}
+
+
+	TEST_FUNCTION(loadAllOfType)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_allOfType.bin";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+
+		auto check = [&](const std::vector<Entity>& loadedEntities, const std::vector<Marker>& loadedMarkers)
+		{
+			TEST_COMPARE(loadedEntities.size(), entities.size());
+			TEST_COMPARE(loadedMarkers.size(), markers.size());
+			for (std::size_t i = 0; i < loadedEntities.size(); ++i)
+			{
+				TEST_COMPARE(loadedEntities[i].health, static_cast<int>(i));
+				TEST_COMPARE(loadedEntities[i].getID(), entities[i].getID());
+			}
+			for (std::size_t i = 0; i < loadedMarkers.size(); ++i)
+				TEST_COMPARE(loadedMarkers[i].getID(), markers[i].getID());
+		};
+
+		ObjectSerializer::Serializer serializer;
+		std::vector<Entity> loadedEntities;
+		std::vector<Marker> loadedMarkers;
+		TEST_ASSERT(serializer.loadAllOfType(filename, loadedEntities));
+		TEST_ASSERT(serializer.loadAllOfType(filename, loadedMarkers));
+		check(loadedEntities, loadedMarkers);
+
+		ObjectSerializer::FileIndex index;
+		TEST_ASSERT(index.build(filename));
+		TEST_COMPARE(index.getOffsets<Marker>().size(), markers.size());
+		TEST_ASSERT(index.saveToFile(filename + ".idx"));
+
+		ObjectSerializer::FileIndex storedIndex;
+		TEST_ASSERT(storedIndex.loadFromFile(filename + ".idx"));
+		TEST_COMPARE(storedIndex.size(), index.size());
+		TEST_ASSERT(serializer.loadAllOfType(filename, storedIndex, loadedEntities));
+		TEST_ASSERT(serializer.loadAllOfType(filename, storedIndex, loadedMarkers));
+		check(loadedEntities, loadedMarkers);
+
+		// Corrupt counts fail instead of allocating
+		const std::uint64_t hugeCount = 1ULL << 60;
+		const std::string corruptFilename = filename + ".corrupt.idx";
+		const std::streamoff offsetCountPosition = static_cast<std::streamoff>(2 * sizeof(std::uint64_t) + index.size() * 3 * sizeof(std::uint64_t) + 2 * sizeof(std::uint64_t));
+		for (const std::streamoff position : { static_cast<std::streamoff>(sizeof(std::uint64_t)), offsetCountPosition })
+		{
+			std::filesystem::copy_file(filename + ".idx", corruptFilename, std::filesystem::copy_options::overwrite_existing);
+			{
+				std::fstream file(corruptFilename, std::ios::binary | std::ios::in | std::ios::out);
+				file.seekp(position);
+				file.write(reinterpret_cast<const char*>(&hugeCount), sizeof(hugeCount));
+			}
+			TEST_ASSERT(!storedIndex.loadFromFile(corruptFilename));
+			TEST_COMPARE(storedIndex.size(), std::size_t(0));
+		}
+	}
+
+
+	TEST_FUNCTION(removeAndCompact)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_remove.bin";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+		const auto fileSize = std::filesystem::file_size(filename);
+
+		ObjectSerializer::Serializer serializer;
+		ObjectSerializer::ISerializableID* obj = nullptr;
+		TEST_ASSERT(serializer.removeFromFile(filename, entities[5].getID()));
+		TEST_ASSERT(!serializer.loadFromFile(filename, entities[5].getID(), obj));
+		TEST_ASSERT(!serializer.removeFromFile(filename, entities[5].getID()));
+
+		// The new entity takes the space of the removed one
+		Entity added;
+		added.health = 1000;
+		TEST_ASSERT(serializer.addToFile(filename, &added));
+		TEST_COMPARE(std::filesystem::file_size(filename), fileSize);
+		TEST_ASSERT(serializer.loadFromFile(filename, added.getID(), obj));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 1000);
+		delete obj;
+
+		// Same with an index, a marker has no free slot and gets appended
+		ObjectSerializer::FileIndex index;
+		TEST_ASSERT(index.build(filename));
+		TEST_ASSERT(serializer.removeFromFile(filename, index, entities[6].getID()));
+		TEST_COMPARE(index.getFreeOffsets(typeid(Entity).hash_code()).size(), std::size_t(1));
+		Entity addedWithIndex;
+		Marker marker;
+		TEST_ASSERT(serializer.addToFile(filename, index, &addedWithIndex));
+		TEST_ASSERT(serializer.addToFile(filename, index, &marker));
+		TEST_ASSERT(index.getFreeOffsets(typeid(Entity).hash_code()).empty());
+		TEST_ASSERT(std::filesystem::file_size(filename) > fileSize);
+		std::vector<ObjectSerializer::ISerializableID*> objs;
+		const std::vector<std::size_t> ids = { addedWithIndex.getID(), marker.getID(), entities[6].getID() };
+		TEST_ASSERT(serializer.loadFromFile(filename, index, ids, objs));
+		TEST_ASSERT(objs[0] != nullptr && objs[1] != nullptr && objs[2] == nullptr);
+		for (auto loaded : objs)
+			delete loaded;
+
+		// Compaction drops the removed records
+		TEST_ASSERT(serializer.removeFromFile(filename, entities[7].getID()));
+		TEST_ASSERT(serializer.removeFromFile(filename, markers[0].getID()));
+		const auto sizeBeforeCompaction = std::filesystem::file_size(filename);
+		TEST_ASSERT(serializer.compactFileAsync(filename).get());
+		TEST_ASSERT(std::filesystem::file_size(filename) < sizeBeforeCompaction);
+		std::vector<Entity> loadedEntities;
+		std::vector<Marker> loadedMarkers;
+		TEST_ASSERT(serializer.loadAllOfType(filename, loadedEntities));
+		TEST_ASSERT(serializer.loadAllOfType(filename, loadedMarkers));
+		TEST_COMPARE(loadedEntities.size(), entities.size() - 1);
+		TEST_COMPARE(loadedMarkers.size(), markers.size());
+
+		// A truncated record fails the compaction and keeps the file
+		std::ofstream(filename, std::ios::binary | std::ios::app).write("abc", 3);
+		const auto truncatedSize = std::filesystem::file_size(filename);
+		TEST_ASSERT(!serializer.compactFile(filename));
+		TEST_COMPARE(std::filesystem::file_size(filename), truncatedSize);
+		const std::string compactPrefix = std::filesystem::path(filename + ".compact").filename().string();
+		for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::absolute(filename).parent_path()))
+			TEST_ASSERT(entry.path().filename().string().rfind(compactPrefix, 0) != 0);
+	}
+
+
+	TEST_FUNCTION(journal)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_journal.bin";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+		// A journal left by an earlier run belongs to another data file
+		std::filesystem::remove(filename + ".wal");
+
+		ObjectSerializer::Journal::Settings journalSettings;
+		journalSettings.commitDelay = std::chrono::microseconds(500);
+		journalSettings.checkpointBytes = 0;
+		{
+			ObjectSerializer::Journal journal(filename, ObjectSerializer::Serializer::Settings(), journalSettings);
+			TEST_ASSERT(journal.open());
+
+			// Concurrent updates share the syncs of the journal
+			std::vector<std::thread> writers;
+			std::atomic<std::size_t> acknowledged = 0;
+			for (std::size_t t = 0; t < 4; ++t)
+			{
+				writers.emplace_back([&entities, &journal, &acknowledged, t]()
+					{
+						for (std::size_t i = t; i < 100; i += 4)
+						{
+							Entity changed = entities[i];
+							changed.health = -1 - static_cast<int>(i);
+							if (journal.overrideInFile(&changed))
+								acknowledged.fetch_add(1, std::memory_order_relaxed);
+						}
+					});
+			}
+			for (auto& writer : writers)
+				writer.join();
+			TEST_COMPARE(acknowledged.load(), std::size_t(100));
+			TEST_COMPARE(journal.getPendingCount(), std::size_t(100));
+
+			// The data file is unchanged until the checkpoint
+			ObjectSerializer::ISerializableID* obj = nullptr;
+			TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, entities[42].getID(), obj, ObjectSerializer::Serializer::Settings()));
+			TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 42);
+			delete obj;
+			TEST_ASSERT(journal.loadFromFile(entities[42].getID(), obj));
+			TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, -43);
+			delete obj;
+
+			// Keep the state of a crash before the checkpoint
+			std::filesystem::copy_file(filename, filename + ".crash", std::filesystem::copy_options::overwrite_existing);
+			std::filesystem::copy_file(journal.getJournalFilename(), filename + ".wal.crash", std::filesystem::copy_options::overwrite_existing);
+
+			TEST_ASSERT(journal.checkpoint());
+			TEST_COMPARE(journal.getPendingCount(), std::size_t(0));
+			TEST_COMPARE(std::filesystem::file_size(journal.getJournalFilename()), std::uintmax_t(0));
+			TEST_ASSERT(journal.close());
+		}
+		std::vector<Entity> loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadAllOfType(filename, loaded, ObjectSerializer::Serializer::Settings()));
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+			TEST_COMPARE(loaded[i].health, i < 100 ? -1 - static_cast<int>(i) : static_cast<int>(i));
+
+		// Recovery applies the journal with a torn last entry
+		std::filesystem::rename(filename + ".crash", filename);
+		std::filesystem::rename(filename + ".wal.crash", filename + ".wal");
+		std::filesystem::resize_file(filename + ".wal", std::filesystem::file_size(filename + ".wal") - 3);
+		{
+			ObjectSerializer::Journal journal(filename, ObjectSerializer::Serializer::Settings(), journalSettings);
+			TEST_ASSERT(journal.open());
+		}
+		TEST_ASSERT(ObjectSerializer::Serializer::loadAllOfType(filename, loaded, ObjectSerializer::Serializer::Settings()));
+		std::size_t updated = 0;
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+			updated += loaded[i].health < 0 ? 1 : 0;
+		TEST_COMPARE(updated, std::size_t(99));
+
+		// Updates of a sorted file keep its sparse index
+		ObjectSerializer::Serializer::Settings sortedSettings;
+		sortedSettings.sparseIndexInterval = 16;
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (Entity& entity : entities)
+			objs.push_back(&entity);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, objs, sortedSettings));
+		const auto sortedSize = std::filesystem::file_size(filename);
+		{
+			ObjectSerializer::Journal journal(filename, sortedSettings, journalSettings);
+			TEST_ASSERT(journal.open());
+			Entity changed = entities[7];
+			changed.health = -100;
+			TEST_ASSERT(journal.overrideInFile(&changed));
+			TEST_ASSERT(journal.close());
+			TEST_ASSERT(journal.open());
+			TEST_ASSERT(journal.close());
+		}
+		TEST_COMPARE(std::filesystem::file_size(filename), sortedSize);
+		TEST_ASSERT(ObjectSerializer::Serializer::isSortedFile(filename));
+		ObjectSerializer::ISerializableID* obj = nullptr;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, entities[7].getID(), obj, sortedSettings));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, -100);
+		delete obj;
+	}
+
+
+	TEST_FUNCTION(shardedStore)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		ObjectSerializer::Serializer::registerType<Entity>();
+		std::vector<Entity> entities(500);
+		std::vector<ObjectSerializer::ISerializableID*> objs;
+		for (std::size_t i = 0; i < entities.size(); ++i)
+		{
+			entities[i].health = static_cast<int>(i);
+			objs.push_back(&entities[i]);
+		}
+
+		const std::string manifest = "TST_IDStore_shards.manifest";
+		{
+			ObjectSerializer::ShardedStore store(manifest);
+			TEST_ASSERT(store.create(4));
+			TEST_ASSERT(store.save(objs));
+			for (std::size_t i = 0; i < store.getShardCount(); ++i)
+				TEST_ASSERT(std::filesystem::file_size(store.getShardFilename(i)) > 0);
+
+			Entity changed = entities[123];
+			changed.health = -1;
+			TEST_ASSERT(store.overrideInFile(&changed));
+			// The stored filter is removed by a write and stored again by flush()
+			const std::string changedFilter = store.getShardFilename(store.getShardIndex(changed.getID())) + ".bloom";
+			TEST_ASSERT(!std::filesystem::exists(changedFilter));
+			TEST_ASSERT(store.flush());
+			TEST_ASSERT(std::filesystem::exists(changedFilter));
+			Entity added;
+			TEST_ASSERT(store.addToFile(&added));
+			TEST_ASSERT(store.removeFromFile(added.getID()));
+		}
+
+		// A second store finds the shards through the manifest, the destructor stored the filters
+		for (std::size_t i = 0; i < 4; ++i)
+			TEST_ASSERT(std::filesystem::exists(manifest + "." + std::to_string(i) + ".bloom"));
+		ObjectSerializer::ShardedStore store(manifest);
+		TEST_ASSERT(store.open());
+		TEST_COMPARE(store.getShardCount(), std::size_t(4));
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(store.load(loaded));
+		TEST_COMPARE(loaded.size(), entities.size());
+		for (auto obj : loaded)
+			delete obj;
+
+		const std::vector<std::size_t> ids = { entities[123].getID(), entities[7].getID(), static_cast<std::size_t>(-5) };
+		std::vector<ObjectSerializer::ISerializableID*> found;
+		TEST_ASSERT(store.loadFromFile(ids, found));
+		TEST_COMPARE(dynamic_cast<Entity*>(found[0])->health, -1);
+		TEST_COMPARE(dynamic_cast<Entity*>(found[1])->health, 7);
+		TEST_ASSERT(found[2] == nullptr);
+		for (auto obj : found)
+			delete obj;
+
+		// Range partitioning keeps neighbouring IDs together
+		ObjectSerializer::ShardedStore rangeStore(manifest);
+		const std::size_t firstID = entities[0].getID();
+		TEST_ASSERT(rangeStore.create(3, ObjectSerializer::ShardedStore::Partitioning::Range, firstID + 100));
+		TEST_COMPARE(rangeStore.getShardIndex(firstID), std::size_t(0));
+		TEST_COMPARE(rangeStore.getShardIndex(firstID + 100), std::size_t(1));
+		TEST_COMPARE(rangeStore.getShardIndex(static_cast<std::size_t>(-5)), std::size_t(2));
+		TEST_ASSERT(rangeStore.save(objs));
+		ObjectSerializer::ISerializableID* obj = nullptr;
+		TEST_ASSERT(rangeStore.loadFromFile(entities[499].getID(), obj));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 499);
+		delete obj;
+
+		// Shard names with spaces are read back from the manifest
+		const std::string spacedManifest = "TST_IDStore shards.manifest";
+		{
+			ObjectSerializer::ShardedStore spacedStore(spacedManifest);
+			TEST_ASSERT(spacedStore.create(2));
+			TEST_ASSERT(spacedStore.save(objs));
+		}
+		ObjectSerializer::ShardedStore spacedStore(spacedManifest);
+		TEST_ASSERT(spacedStore.open());
+		TEST_COMPARE(spacedStore.getShardFilename(1), spacedManifest + ".1");
+		TEST_ASSERT(spacedStore.loadFromFile(entities[42].getID(), obj));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 42);
+		delete obj;
+
+		// Manifests with a range size of 0 or too many shards are rejected
+		TEST_ASSERT(!ObjectSerializer::ShardedStore(manifest).create(ObjectSerializer::ShardedStore::s_maxShardCount + 1));
+		const std::string invalidManifests[] = {
+			"ObjectSerializer shards 1\npartitioning range\nrangeSize 0\nshards 1\nshard\n",
+			"ObjectSerializer shards 1\npartitioning hash\nrangeSize 0\nshards 1000000000\nshard\n"
+		};
+		for (const std::string& content : invalidManifests)
+		{
+			std::ofstream(manifest, std::ios::trunc) << content;
+			TEST_ASSERT(!ObjectSerializer::ShardedStore(manifest).open());
+		}
+	}
+
+
+	TEST_FUNCTION(bloomFilter)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_bloom.dat";
+		const std::string filterFilename = filename + ".bloom";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers, 1000));
+
+		ObjectSerializer::BloomFilter filter;
+		TEST_ASSERT(filter.build(filename));
+		for (const Entity& entity : entities)
+			TEST_ASSERT(filter.mightContain(entity.getID()));
+		std::size_t falsePositives = 0;
+		for (std::size_t i = 1; i <= 10000; ++i)
+			falsePositives += filter.mightContain(static_cast<std::size_t>(-1) - i) ? 1 : 0;
+		TEST_ASSERT(falsePositives < 300);
+
+		TEST_ASSERT(filter.saveToFile(filterFilename, filename));
+		ObjectSerializer::BloomFilter loaded;
+		TEST_ASSERT(loaded.loadFromFile(filterFilename, filename));
+		TEST_COMPARE(loaded.getBitCount(), filter.getBitCount());
+		for (const Entity& entity : entities)
+			TEST_ASSERT(loaded.mightContain(entity.getID()));
+
+		std::size_t absentID = static_cast<std::size_t>(-1);
+		while (filter.mightContain(absentID))
+			--absentID;
+		ObjectSerializer::ISerializableID* obj = nullptr;
+		TEST_ASSERT(!ObjectSerializer::Serializer::loadFromFile(filename, filter, absentID, obj, ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(obj == nullptr);
+		const std::vector<std::size_t> ids = { absentID, entities[42].getID() };
+		std::vector<ObjectSerializer::ISerializableID*> found;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, filter, ids, found, ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(found[0] == nullptr);
+		TEST_COMPARE(dynamic_cast<Entity*>(found[1])->health, 42);
+		delete found[1];
+
+		// The filter does not know objects which were added later
+		Entity added;
+		TEST_ASSERT(ObjectSerializer::Serializer::addToFile(filename, &added, ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(!loaded.loadFromFile(filterFilename, filename));
+		TEST_ASSERT(loaded.mightContain(added.getID()));
+
+		// Neither do they if the object reused a free slot within the same file time
+		TEST_ASSERT(filter.build(filename));
+		TEST_ASSERT(filter.saveToFile(filterFilename, filename));
+		TEST_ASSERT(!std::filesystem::exists(filterFilename + ".tmp"));
+		const auto sizeBefore = std::filesystem::file_size(filename);
+		const auto timeBefore = std::filesystem::last_write_time(filename);
+		Entity reused;
+		TEST_ASSERT(ObjectSerializer::Serializer::removeFromFile(filename, entities[7].getID(), ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(ObjectSerializer::Serializer::addToFile(filename, &reused, ObjectSerializer::Serializer::Settings()));
+		std::filesystem::last_write_time(filename, timeBefore);
+		TEST_COMPARE(std::filesystem::file_size(filename), sizeBefore);
+		TEST_ASSERT(!loaded.loadFromFile(filterFilename, filename));
+	}
+
+
+	TEST_FUNCTION(sortedRange)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		ObjectSerializer::Serializer::registerType<Entity>();
+		ObjectSerializer::Serializer::registerType<Marker>();
+		std::vector<Entity> entities(1000);
+		Marker marker;
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		// Saved in reverse, the file is sorted anyway
+		for (std::size_t i = entities.size(); i > 0; --i)
+		{
+			entities[i - 1].health = static_cast<int>(i - 1);
+			objs.push_back(&entities[i - 1]);
+		}
+		objs.push_back(&marker);
+
+		ObjectSerializer::Serializer::Settings settings;
+		settings.sparseIndexInterval = 16;
+		const std::string filename = "TST_IDStore_sorted.dat";
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, objs, settings));
+
+		const std::size_t firstID = entities[0].getID();
+		std::vector<ObjectSerializer::ISerializableID*> range;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadRange(filename, firstID + 100, firstID + 199, range, settings));
+		TEST_COMPARE(range.size(), std::size_t(100));
+		for (std::size_t i = 0; i < range.size(); ++i)
+		{
+			TEST_COMPARE(range[i]->getID(), firstID + 100 + i);
+			delete range[i];
+		}
+
+		ObjectSerializer::ISerializableID* obj = nullptr;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, entities[777].getID(), obj, settings));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 777);
+		delete obj;
+		TEST_ASSERT(!ObjectSerializer::Serializer::loadFromFile(filename, firstID - 1, obj, settings));
+
+		// Other loaders stop in front of the index
+		std::vector<ObjectSerializer::ISerializable*> all;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, all, ObjectSerializer::Serializer::Settings()));
+		TEST_COMPARE(all.size(), objs.size());
+		for (auto loaded : all)
+			delete loaded;
+
+		// Compacting keeps the file sorted and indexed
+		Entity added;
+		TEST_ASSERT(!ObjectSerializer::Serializer::addToFile(filename, &added, settings));
+		TEST_ASSERT(ObjectSerializer::Serializer::removeFromFile(filename, entities[150].getID(), settings));
+		// The file is recognized as sorted without the settings, free slots are not reused either
+		TEST_ASSERT(ObjectSerializer::Serializer::isSortedFile(filename));
+		TEST_ASSERT(!ObjectSerializer::Serializer::addToFile(filename, &added, ObjectSerializer::Serializer::Settings()));
+		ObjectSerializer::ConcurrentWriter writer(filename);
+		TEST_ASSERT(!writer.open());
+		TEST_ASSERT(ObjectSerializer::Serializer::compactFile(filename, settings));
+		TEST_ASSERT(ObjectSerializer::Serializer::loadRange(filename, firstID + 140, firstID + 159, range, settings));
+		TEST_COMPARE(range.size(), std::size_t(19));
+		for (auto loaded : range)
+			delete loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, entities[999].getID(), obj, settings));
+		TEST_COMPARE(dynamic_cast<Entity*>(obj)->health, 999);
+		delete obj;
+
+		// Files without index get scanned
+		std::vector<Entity> unsortedEntities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, unsortedEntities, markers));
+		const std::size_t unsortedID = unsortedEntities[10].getID();
+		TEST_ASSERT(ObjectSerializer::Serializer::loadRange(filename, unsortedID, unsortedID + 4, range, ObjectSerializer::Serializer::Settings()));
+		TEST_COMPARE(range.size(), std::size_t(5));
+		for (auto loaded : range)
+			delete loaded;
+	}
+
+
+	TEST_FUNCTION(lazyRef)
+	{
+		TEST_START;
+		using namespace TST_IDStoreTypes;
+		const std::string filename = "TST_IDStore_lazy.dat";
+		std::vector<Entity> entities;
+		std::vector<Marker> markers;
+		TEST_ASSERT(createStore(filename, entities, markers));
+
+		auto file = std::make_shared<ObjectSerializer::LazyFile>(filename);
+		ObjectSerializer::LazyRef<Entity> ref(file, entities[42].getID());
+		TEST_ASSERT(!ref.isLoaded());
+		TEST_COMPARE(ref->health, 42);
+		TEST_ASSERT(ref.isLoaded());
+		// Copies share the loaded object
+		ObjectSerializer::LazyRef<Entity> copy = ref;
+		TEST_ASSERT(copy.get() == ref.get());
+
+		// Wrong type or missing ID resolve to nullptr
+		ObjectSerializer::LazyRef<Entity> marker(file, markers[0].getID());
+		TEST_ASSERT(marker.get() == nullptr);
+		ObjectSerializer::LazyRef<Entity> missing(file, static_cast<std::size_t>(-5));
+		TEST_ASSERT(missing.get() == nullptr);
+
+		TEST_ASSERT(file->open());
+		std::vector<ObjectSerializer::LazyRef<Entity>> refs;
+		for (std::size_t i = 0; i < entities.size(); i += 3)
+			refs.emplace_back(file, entities[i].getID());
+		refs.emplace_back(file, entities[0].getID());
+		refs.emplace_back(file, static_cast<std::size_t>(-5));
+		TEST_ASSERT(ObjectSerializer::LazyRef<Entity>::prefetch(refs));
+		for (std::size_t i = 0; i + 2 < refs.size(); ++i)
+		{
+			TEST_ASSERT(refs[i].isLoaded());
+			TEST_COMPARE(refs[i]->health, static_cast<int>(i * 3));
+		}
+		TEST_ASSERT(refs[refs.size() - 2].get() == refs[0].get());
+		TEST_ASSERT(refs.back().isLoaded());
+		TEST_ASSERT(refs.back().get() == nullptr);
+	}
+
+};
+
+TEST_INSTANTIATE(TST_IDStore);
@@ -0,0 +1,944 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "ObjectSerializer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+namespace TST_SerializerTypes
+{
+	struct Particle : public ObjectSerializer::ISerializableID
+	{
+		float x = 0;
+		float y = 0;
+		char tag[5] = "    ";
+	};
+	struct Config : public ObjectSerializer::ISerializable
+	{
+		int a = 1;
+		int b = 2;
+	};
+	struct Large : public ObjectSerializer::ISerializable
+	{
+		int values[19] = { 0 };
+		virtual int first() const { return values[0]; }
+	};
+	struct Padded : public ObjectSerializer::ISerializableID
+	{
+		char c = 'c';
+		double d = 0;
+		char e = 'e';
+	};
+	struct Node : public ObjectSerializer::ISerializableID
+	{
+		int value = 0;
+		Node* parent = nullptr;
+		const Node* next = nullptr;
+	};
+	struct PackedNode : public ObjectSerializer::ISerializable
+	{
+		int value = 0;
+		PackedNode* parent = nullptr;
+		Node* other = nullptr;
+	};
+
+	inline void registerTypes()
+	{
+		ObjectSerializer::Serializer::registerType<Particle>();
+		ObjectSerializer::Serializer::registerType<Config>();
+	}
+
+	inline void deleteAll(std::vector<ObjectSerializer::ISerializable*>& objs)
+	{
+		for (auto obj : objs)
+			delete obj;
+		objs.clear();
+	}
+
+	// True if a temporary file of an atomic save of filename is left
+	inline bool hasTempFile(const std::string& filename)
+	{
+		const std::string prefix = std::filesystem::path(filename + ".tmp").filename().string();
+		for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::absolute(filename).parent_path()))
+		{
+			if (entry.path().filename().string().rfind(prefix, 0) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+class TST_Serializer : public UnitTest::Test
+{
+	TEST_CLASS(TST_Serializer)
+public:
+	TST_Serializer()
+		: Test("TST_Serializer")
+	{
+		ADD_TEST(TST_Serializer::bufferRoundTrip);
+		ADD_TEST(TST_Serializer::spanSinkOverflow);
+		ADD_TEST(TST_Serializer::perInstanceSettings);
+		ADD_TEST(TST_Serializer::packedEncoding);
+		ADD_TEST(TST_Serializer::scan);
+		ADD_TEST(TST_Serializer::arrayRoundTrip);
+		ADD_TEST(TST_Serializer::arrayPayloadSizes);
+		ADD_TEST(TST_Serializer::atomicSave);
+		ADD_TEST(TST_Serializer::readAhead);
+		ADD_TEST(TST_Serializer::objectGraph);
+		ADD_TEST(TST_Serializer::deduplicate);
+		ADD_TEST(TST_Serializer::sharedMemory);
+		ADD_TEST(TST_Serializer::followFile);
+		ADD_TEST(TST_Serializer::concurrentWriter);
+		ADD_TEST(TST_Serializer::checkpoint);
+
+	}
+
+private:
+
+	// Tests
+	TEST_FUNCTION(bufferRoundTrip)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		Particle p1;
+		p1.x = 1.5f;
+		p1.y = -2.f;
+		std::memcpy(p1.tag, "ABCD", 5);
+		Config c1;
+		c1.a = 42;
+
+		ObjectSerializer::Serializer serializer;
+		serializer.addObject(&p1);
+		serializer.addObject(&c1);
+
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(serializer.saveTo(sink));
+		TEST_ASSERT(!buffer.empty());
+
+		ObjectSerializer::Serializer deserializer;
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(deserializer.loadFrom(source));
+		std::vector<ObjectSerializer::ISerializable*> objs = deserializer.getObjects();
+		TEST_COMPARE(objs.size(), std::size_t(2));
+
+		Particle* p2 = dynamic_cast<Particle*>(objs[0]);
+		Config* c2 = dynamic_cast<Config*>(objs[1]);
+		TEST_ASSERT(p2 != nullptr);
+		TEST_ASSERT(c2 != nullptr);
+		TEST_COMPARE(p2->getID(), p1.getID());
+		TEST_COMPARE(p2->x, p1.x);
+		TEST_COMPARE(p2->y, p1.y);
+		TEST_ASSERT(std::memcmp(p2->tag, "ABCD", 5) == 0);
+		TEST_COMPARE(c2->a, 42);
+		deleteAll(objs);
+	}
+
+
+
+
+	TEST_FUNCTION(spanSinkOverflow)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		Config c1;
+		std::vector<ObjectSerializer::ISerializable*> objs{ &c1 };
+
+		char small[4];
+		ObjectSerializer::SpanSink sink(small);
+		TEST_ASSERT(!ObjectSerializer::Serializer::saveTo(sink, objs));
+		TEST_COMPARE(sink.getPosition(), std::size_t(0));
+	}
+
+
+
+
+	TEST_FUNCTION(perInstanceSettings)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		Config c1;
+		c1.a = 7;
+		ObjectSerializer::Serializer::Settings withVtable;
+		withVtable.serializeVtable = true;
+		ObjectSerializer::Serializer a;
+		ObjectSerializer::Serializer b(withVtable);
+		a.addObject(&c1);
+		b.addObject(&c1);
+
+		std::vector<char> bufferA, bufferB;
+		ObjectSerializer::BufferSink sinkA(bufferA), sinkB(bufferB);
+		TEST_ASSERT(a.saveTo(sinkA));
+		TEST_ASSERT(b.saveTo(sinkB));
+		TEST_COMPARE(bufferA.size() + sizeof(void*), bufferB.size());
+
+		// Only the payload behind the vtable pointer gets loaded back
+		ObjectSerializer::Serializer loader;
+		ObjectSerializer::BufferSource source(bufferA);
+		TEST_ASSERT(loader.loadFrom(source));
+		TEST_COMPARE(loader.getObjects().size(), std::size_t(1));
+		Config* c2 = dynamic_cast<Config*>(loader.getObjects()[0]);
+		TEST_ASSERT(c2 != nullptr);
+		TEST_COMPARE(c2->a, 7);
+		std::vector<ObjectSerializer::ISerializable*> objs = loader.getObjects();
+		deleteAll(objs);
+	}
+
+
+
+
+	TEST_FUNCTION(packedEncoding)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		// Registering must not construct a Padded, that would use up an ID.
+		// Seeding moves this thread to a fresh block, its IDs are consecutive.
+		ObjectSerializer::IDAllocator::seed(ObjectSerializer::IDAllocator::getNextFreeID());
+		const std::size_t id = ObjectSerializer::IDAllocator::allocate();
+		ObjectSerializer::Serializer::registerMembers<Padded>(&Padded::c, &Padded::d, &Padded::e);
+		TEST_COMPARE(ObjectSerializer::IDAllocator::allocate(), id + 1);
+
+		std::vector<Padded> objects(100);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < objects.size(); ++i)
+		{
+			objects[i].d = static_cast<double>(i) * 0.5;
+			objects[i].e = static_cast<char>('a' + i % 26);
+			objs.push_back(&objects[i]);
+		}
+
+		ObjectSerializer::Serializer::Settings packed;
+		ObjectSerializer::Serializer::Settings raw;
+		raw.packedEncoding = false;
+		std::vector<char> packedBuffer, rawBuffer;
+		ObjectSerializer::BufferSink packedSink(packedBuffer), rawSink(rawBuffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(packedSink, objs, packed));
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(rawSink, objs, raw));
+
+		// type hash + c + d + e + id
+		const std::size_t packedRecordSize = sizeof(std::size_t) + 1 + sizeof(double) + 1 + sizeof(std::size_t);
+		TEST_COMPARE(packedBuffer.size(), objects.size() * packedRecordSize);
+		TEST_ASSERT(packedBuffer.size() < rawBuffer.size());
+
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		ObjectSerializer::BufferSource source(packedBuffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFrom(source, loaded, packed));
+		TEST_COMPARE(loaded.size(), objects.size());
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+		{
+			Padded* p = dynamic_cast<Padded*>(loaded[i]);
+			TEST_ASSERT(p != nullptr);
+			TEST_COMPARE(p->getID(), objects[i].getID());
+			TEST_COMPARE(p->d, objects[i].d);
+			TEST_COMPARE(p->e, objects[i].e);
+		}
+		deleteAll(loaded);
+	}
+
+
+
+
+	TEST_FUNCTION(scan)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		std::vector<Particle> particles(100);
+		std::vector<Config> configs(100);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			configs[i].a = static_cast<int>(i);
+			objs.push_back(&particles[i]);
+			objs.push_back(&configs[i]);
+		}
+
+		ObjectSerializer::Serializer::Settings settings;
+		settings.lengthFramedRecords = true;
+		ObjectSerializer::Serializer serializer(settings);
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, objs, settings));
+
+		std::vector<Particle*> matches;
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(serializer.scan<Particle>(source, [](const Particle& p) { return p.x >= 90; }, matches));
+		TEST_COMPARE(matches.size(), std::size_t(10));
+		for (std::size_t i = 0; i < matches.size(); ++i)
+		{
+			TEST_COMPARE(matches[i]->x, static_cast<float>(90 + i));
+			TEST_COMPARE(matches[i]->getID(), particles[90 + i].getID());
+			delete matches[i];
+		}
+
+		// Raw predicate over all types
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		ObjectSerializer::BufferSource rawSource(buffer);
+		std::size_t visited = 0;
+		TEST_ASSERT(serializer.scan(rawSource, {}, [&visited](std::size_t, const char*, std::size_t)
+			{
+				return visited++ % 2 == 0;
+			}, loaded));
+		TEST_COMPARE(visited, objs.size());
+		TEST_COMPARE(loaded.size(), particles.size());
+		deleteAll(loaded);
+	}
+
+
+
+
+	TEST_FUNCTION(arrayRoundTrip)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		std::vector<Particle> particles(1000);
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			particles[i].y = -static_cast<float>(i);
+		}
+
+		ObjectSerializer::Serializer serializer;
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(serializer.saveArray<Particle>(sink, particles));
+		// One block header, the vtable pointer is not stored
+		TEST_COMPARE(buffer.size(), 3 * sizeof(std::uint64_t) + particles.size() * (sizeof(Particle) - sizeof(void*)));
+
+		std::vector<Particle> loaded;
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(serializer.loadArray(source, loaded));
+		TEST_COMPARE(loaded.size(), particles.size());
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+		{
+			TEST_COMPARE(loaded[i].getID(), particles[i].getID());
+			TEST_COMPARE(loaded[i].x, particles[i].x);
+			TEST_COMPARE(loaded[i].y, particles[i].y);
+		}
+		// Loaded objects keep a working vtable
+		TEST_ASSERT(dynamic_cast<ObjectSerializer::ISerializableID*>(static_cast<ObjectSerializer::ISerializable*>(&loaded.back())) != nullptr);
+
+		// A block of another type is rejected
+		std::vector<Config> configs;
+		ObjectSerializer::BufferSource wrongSource(buffer);
+		TEST_ASSERT(!serializer.loadArray(wrongSource, configs));
+		TEST_ASSERT(configs.empty());
+
+		// A corrupt count fails at the end of the data instead of allocating it
+		std::vector<char> corrupt = buffer;
+		const std::uint64_t hugeCount = std::uint64_t(1) << 60;
+		std::memcpy(corrupt.data() + sizeof(std::uint64_t), &hugeCount, sizeof(hugeCount));
+		ObjectSerializer::BufferSource corruptSource(corrupt);
+		TEST_ASSERT(!serializer.loadArray(corruptSource, loaded));
+		TEST_ASSERT(loaded.size() <= particles.size());
+	}
+
+
+
+	TEST_FUNCTION(arrayPayloadSizes)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		ObjectSerializer::Serializer::registerType<Large>();
+
+		// Payloads smaller than a vector register and payloads with a partial last vector
+		std::vector<Config> configs(33);
+		std::vector<Large> larges(17);
+		for (std::size_t i = 0; i < configs.size(); ++i)
+		{
+			configs[i].a = static_cast<int>(i);
+			configs[i].b = -static_cast<int>(i);
+		}
+		for (std::size_t i = 0; i < larges.size(); ++i)
+			for (std::size_t j = 0; j < 19; ++j)
+				larges[i].values[j] = static_cast<int>(i * 100 + j);
+
+		ObjectSerializer::Serializer serializer;
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(serializer.saveArray<Config>(sink, configs));
+		TEST_ASSERT(serializer.saveArray<Large>(sink, larges));
+
+		std::vector<Config> loadedConfigs;
+		std::vector<Large> loadedLarges;
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(serializer.loadArray(source, loadedConfigs));
+		TEST_ASSERT(serializer.loadArray(source, loadedLarges));
+		TEST_COMPARE(loadedConfigs.size(), configs.size());
+		TEST_COMPARE(loadedLarges.size(), larges.size());
+		for (std::size_t i = 0; i < configs.size(); ++i)
+		{
+			TEST_COMPARE(loadedConfigs[i].a, configs[i].a);
+			TEST_COMPARE(loadedConfigs[i].b, configs[i].b);
+			// The vtable pointer must survive the wide stores of the neighbouring payload
+			TEST_ASSERT(dynamic_cast<Config*>(static_cast<ObjectSerializer::ISerializable*>(&loadedConfigs[i])) != nullptr);
+		}
+		for (std::size_t i = 0; i < larges.size(); ++i)
+		{
+			const ObjectSerializer::ISerializable* base = &loadedLarges[i];
+			TEST_COMPARE(dynamic_cast<const Large*>(base)->first(), static_cast<int>(i * 100));
+			TEST_ASSERT(std::memcmp(loadedLarges[i].values, larges[i].values, sizeof(larges[i].values)) == 0);
+		}
+	}
+
+
+
+	TEST_FUNCTION(atomicSave)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+
+		// Writes of the background thread keep their order
+		std::vector<char> buffer;
+		{
+			ObjectSerializer::BufferSink target(buffer);
+			ObjectSerializer::BackgroundSink sink(target, 7);
+			for (char c = 0; c < 100; ++c)
+				TEST_ASSERT(sink.write(&c, 1));
+			TEST_ASSERT(sink.flush());
+		}
+		TEST_COMPARE(buffer.size(), std::size_t(100));
+		for (std::size_t i = 0; i < buffer.size(); ++i)
+			TEST_COMPARE(buffer[i], static_cast<char>(i));
+
+		// Large enough to be written in several background flushes
+		std::vector<Particle> particles(100000);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			objs.push_back(&particles[i]);
+		}
+		const std::string filename = "TST_Serializer_atomicSave.bin";
+		ObjectSerializer::Serializer::Settings settings;
+		settings.atomicSave = true;
+		settings.syncPolicy = ObjectSerializer::Serializer::SyncPolicy::Full;
+		std::vector<ObjectSerializer::ISerializable*> first = { objs[0] };
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, first, settings));
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, objs, settings));
+		TEST_ASSERT(!hasTempFile(filename));
+
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), particles.size());
+		TEST_COMPARE(dynamic_cast<Particle*>(loaded.back())->x, particles.back().x);
+		deleteAll(loaded);
+	}
+
+	TEST_FUNCTION(readAhead)
+	{
+		TEST_START;
+		const std::string filename = "TST_Serializer_readAhead.bin";
+		std::vector<char> content(10007);
+		for (std::size_t i = 0; i < content.size(); ++i)
+			content[i] = static_cast<char>(i % 251);
+		{
+			std::ofstream file(filename, std::ios::binary);
+			file.write(content.data(), static_cast<std::streamsize>(content.size()));
+		}
+
+		// Reads and skips which cross the borders of the small buffers
+		ObjectSerializer::ReadAheadSource source(filename, 64, 3);
+		TEST_ASSERT(source.isOpen());
+		std::size_t position = 0;
+		std::vector<char> chunk(200);
+		for (std::size_t size = 1; position + size <= content.size(); size = size % 199 + 1)
+		{
+			if (size % 3 == 0)
+			{
+				TEST_ASSERT(source.skip(size));
+			}
+			else
+			{
+				TEST_ASSERT(source.read(chunk.data(), size));
+				TEST_ASSERT(std::memcmp(chunk.data(), content.data() + position, size) == 0);
+			}
+			position += size;
+		}
+		TEST_ASSERT(source.read(chunk.data(), content.size() - position));
+		TEST_ASSERT(!source.read(chunk.data(), 1));
+
+		ObjectSerializer::ReadAheadSource missing("TST_Serializer_readAhead.missing");
+		TEST_ASSERT(!missing.isOpen());
+		TEST_ASSERT(!missing.read(chunk.data(), 1));
+	}
+
+	TEST_FUNCTION(objectGraph)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		ObjectSerializer::Serializer::registerPointers<Node>(&Node::parent, &Node::next);
+		// Only registered members are stored, other is not
+		ObjectSerializer::Serializer::registerMembers<PackedNode>(&PackedNode::value, &PackedNode::parent);
+		ObjectSerializer::Serializer::registerPointers<PackedNode>(&PackedNode::parent, &PackedNode::other);
+
+		std::vector<Node> nodes(1000);
+		Node unsaved;
+		std::vector<PackedNode> packed(10);
+		Config config;
+		std::vector<ObjectSerializer::ISerializable*> objs = { &config };
+		for (std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			nodes[i].value = static_cast<int>(i);
+			nodes[i].parent = i > 0 ? &nodes[(i - 1) / 2] : &unsaved;
+			nodes[i].next = &nodes[(i + 1) % nodes.size()];
+			objs.push_back(&nodes[i]);
+		}
+		for (std::size_t i = 0; i < packed.size(); ++i)
+		{
+			packed[i].value = static_cast<int>(i);
+			packed[i].parent = &packed[packed.size() - 1 - i];
+			packed[i].other = &nodes[i];
+			objs.push_back(&packed[i]);
+		}
+
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, objs, ObjectSerializer::Serializer::Settings()));
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFrom(source, loaded, ObjectSerializer::Serializer::Settings()));
+		TEST_COMPARE(loaded.size(), objs.size());
+
+		std::vector<Node*> loadedNodes;
+		for (std::size_t i = 1; i <= nodes.size(); ++i)
+			loadedNodes.push_back(dynamic_cast<Node*>(loaded[i]));
+		TEST_ASSERT(loadedNodes[0]->parent == nullptr);
+		for (std::size_t i = 1; i < loadedNodes.size(); ++i)
+		{
+			TEST_ASSERT(loadedNodes[i]->parent == loadedNodes[(i - 1) / 2]);
+			TEST_ASSERT(loadedNodes[i - 1]->next == loadedNodes[i]);
+		}
+		TEST_ASSERT(loadedNodes.back()->next == loadedNodes.front());
+		for (std::size_t i = 0; i < packed.size(); ++i)
+		{
+			PackedNode* node = dynamic_cast<PackedNode*>(loaded[1 + nodes.size() + i]);
+			TEST_COMPARE(node->value, static_cast<int>(i));
+			TEST_ASSERT(node->parent == loaded[nodes.size() + packed.size() - i]);
+			TEST_ASSERT(node->other == nullptr);
+		}
+		deleteAll(loaded);
+
+		// Objects loaded alone come without their targets
+		const std::string filename = "TST_Serializer_objectGraph.bin";
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, objs, ObjectSerializer::Serializer::Settings()));
+		ObjectSerializer::ISerializableID* single = nullptr;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, nodes[5].getID(), single, ObjectSerializer::Serializer::Settings()));
+		TEST_COMPARE(dynamic_cast<Node*>(single)->value, 5);
+		TEST_ASSERT(dynamic_cast<Node*>(single)->parent == nullptr);
+		TEST_ASSERT(dynamic_cast<Node*>(single)->next == nullptr);
+		delete single;
+
+		// Compaction moves the targets behind a deleted record
+		TEST_ASSERT(ObjectSerializer::Serializer::removeFromFile(filename, nodes[3].getID(), ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(ObjectSerializer::Serializer::compactFile(filename, ObjectSerializer::Serializer::Settings()));
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, ObjectSerializer::Serializer::Settings()));
+		TEST_COMPARE(loaded.size(), objs.size() - 1);
+		Node* node7 = dynamic_cast<Node*>(loaded[7]);
+		Node* node10 = dynamic_cast<Node*>(loaded[10]);
+		TEST_COMPARE(node7->value, 7);
+		TEST_ASSERT(node7->parent == nullptr);
+		TEST_ASSERT(dynamic_cast<Node*>(loaded[3])->next == nullptr);
+		TEST_COMPARE(node10->parent->value, 4);
+		TEST_COMPARE(node10->next->value, 11);
+		deleteAll(loaded);
+
+		// Overriding a node keeps the pointers stored in the file
+		nodes[10].value = 1010;
+		TEST_ASSERT(ObjectSerializer::Serializer::overrideInFile(filename, &nodes[10]));
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded));
+		node10 = dynamic_cast<Node*>(loaded[10]);
+		TEST_COMPARE(node10->value, 1010);
+		TEST_COMPARE(node10->parent->value, 4);
+		TEST_COMPARE(node10->next->value, 11);
+		deleteAll(loaded);
+	}
+	TEST_FUNCTION(deduplicate)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		ObjectSerializer::Serializer::registerType<Large>();
+
+		// Ten distinct payloads, each saved 100 times, with objects with ID in between
+		std::vector<Large> larges(1000);
+		std::vector<Particle> particles(10);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < larges.size(); ++i)
+		{
+			if (i % 100 == 0)
+				objs.push_back(&particles[i / 100]);
+			larges[i].values[0] = static_cast<int>(i % 10);
+			larges[i].values[18] = static_cast<int>(i % 10) * 7;
+			objs.push_back(&larges[i]);
+		}
+
+		const std::string plainFilename = "TST_Serializer_deduplicate_plain.bin";
+		const std::string filename = "TST_Serializer_deduplicate.bin";
+		ObjectSerializer::Serializer::Settings settings;
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(plainFilename, objs, settings));
+		settings.deduplicatePayloads = true;
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, objs, settings));
+		TEST_ASSERT(std::filesystem::file_size(filename) * 4 < std::filesystem::file_size(plainFilename));
+
+		// Copies are objects of their own
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size());
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+		{
+			TEST_ASSERT(typeid(*loaded[i]) == typeid(*objs[i]));
+			if (const Large* large = dynamic_cast<const Large*>(loaded[i]))
+			{
+				TEST_ASSERT(std::memcmp(large->values, dynamic_cast<const Large*>(objs[i])->values, sizeof(large->values)) == 0);
+				TEST_COMPARE(large->first(), large->values[0]);
+			}
+		}
+		TEST_ASSERT(loaded[1] != loaded[11]);
+		deleteAll(loaded);
+
+		// Shared duplicates are the object of their original record
+		settings.duplicatePolicy = ObjectSerializer::Serializer::DuplicatePolicy::Share;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size());
+		TEST_ASSERT(loaded[1] == loaded[11]);
+		TEST_ASSERT(loaded[2] != loaded[11]);
+		std::sort(loaded.begin(), loaded.end());
+		loaded.erase(std::unique(loaded.begin(), loaded.end()), loaded.end());
+		TEST_COMPARE(loaded.size(), std::size_t(10 + particles.size()));
+		deleteAll(loaded);
+
+		// Compaction keeps the references pointing to their original
+		settings.duplicatePolicy = ObjectSerializer::Serializer::DuplicatePolicy::Copy;
+		TEST_ASSERT(ObjectSerializer::Serializer::removeFromFile(filename, particles[0].getID(), settings));
+		TEST_ASSERT(ObjectSerializer::Serializer::compactFile(filename, settings));
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size() - 1);
+		for (std::size_t i = 0; i < 100; ++i)
+		{
+			const Large* large = dynamic_cast<const Large*>(loaded[i]);
+			TEST_ASSERT(large != nullptr);
+			TEST_COMPARE(large->values[18], static_cast<int>(i % 10) * 7);
+		}
+		deleteAll(loaded);
+
+		// Framed records with packed members
+		settings.lengthFramedRecords = true;
+		settings.packedEncoding = true;
+		std::vector<char> buffer;
+		ObjectSerializer::BufferSink sink(buffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, objs, settings));
+		ObjectSerializer::BufferSource source(buffer);
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFrom(source, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size());
+		TEST_COMPARE(dynamic_cast<const Large*>(loaded.back())->values[18], 63);
+		deleteAll(loaded);
+	}
+	TEST_FUNCTION(sharedMemory)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		const std::string name = "TST_Serializer_sharedMemory";
+		ObjectSerializer::SharedMemorySegment::remove(name);
+
+		std::vector<Particle> particles(100);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			objs.push_back(&particles[i]);
+		}
+		ObjectSerializer::SharedMemorySink sink(name, 64 * 1024);
+		TEST_ASSERT(sink.isOpen());
+		ObjectSerializer::SharedMemorySource source(name);
+		TEST_ASSERT(source.isOpen());
+		TEST_ASSERT(!source.beginRead());
+
+		ObjectSerializer::Serializer::Settings settings;
+		sink.begin();
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, objs, settings));
+		TEST_ASSERT(sink.commit());
+		TEST_ASSERT(source.hasUpdate());
+
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(source.beginRead());
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFrom(source, loaded, settings));
+		TEST_ASSERT(source.endRead());
+		TEST_ASSERT(!source.hasUpdate());
+		TEST_COMPARE(loaded.size(), particles.size());
+		TEST_COMPARE(dynamic_cast<Particle*>(loaded.back())->x, 99.f);
+		deleteAll(loaded);
+
+		// A new snapshot invalidates the one being read
+		TEST_ASSERT(source.beginRead());
+		ObjectSerializer::BufferSource view(source.getView());
+		std::size_t typeHash = 0;
+		TEST_ASSERT(view.read(reinterpret_cast<char*>(&typeHash), sizeof(typeHash)));
+		TEST_COMPARE(typeHash, typeid(Particle).hash_code());
+		sink.begin();
+		TEST_ASSERT(!source.endRead());
+		objs.resize(10);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, objs, settings));
+		TEST_ASSERT(sink.commit());
+		TEST_ASSERT(source.hasUpdate());
+		TEST_ASSERT(source.beginRead());
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFrom(source, loaded, settings));
+		TEST_ASSERT(source.endRead());
+		TEST_COMPARE(loaded.size(), std::size_t(10));
+		deleteAll(loaded);
+
+		// Snapshots larger than the segment are published empty
+		for (std::size_t i = 10; i < particles.size(); ++i)
+			objs.push_back(&particles[i]);
+		for (int i = 0; i < 100; ++i)
+			objs.insert(objs.end(), objs.begin(), objs.begin() + 100);
+		sink.begin();
+		TEST_ASSERT(!ObjectSerializer::Serializer::saveTo(sink, objs, settings));
+		TEST_ASSERT(!sink.commit());
+		TEST_ASSERT(source.beginRead());
+		TEST_COMPARE(source.getView().size(), std::size_t(0));
+		TEST_ASSERT(ObjectSerializer::SharedMemorySegment::remove(name));
+	}
+	TEST_FUNCTION(followFile)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		const std::string filename = "TST_Serializer_followFile.bin";
+		ObjectSerializer::Serializer::Settings settings;
+
+		std::vector<Particle> particles(20);
+		std::vector<ObjectSerializer::ISerializable*> objs;
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			objs.push_back(&particles[i]);
+		}
+		std::vector<ObjectSerializer::ISerializable*> first(objs.begin(), objs.begin() + 10);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, first, settings));
+
+		ObjectSerializer::FileFollower follower(filename, settings);
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), std::size_t(10));
+		TEST_COMPARE(follower.getOffset(), static_cast<std::uint64_t>(std::filesystem::file_size(filename)));
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), std::size_t(10));
+		TEST_ASSERT(!follower.waitForChange(std::chrono::milliseconds(20), std::chrono::milliseconds(5)));
+
+		// The tail record is written in two steps
+		std::vector<char> record;
+		ObjectSerializer::BufferSink sink(record);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, { objs[10] }, settings));
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::app);
+			file.write(record.data(), 5);
+		}
+		TEST_ASSERT(follower.waitForChange(std::chrono::milliseconds(1000), std::chrono::milliseconds(5)));
+		const std::uint64_t offset = follower.getOffset();
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), std::size_t(10));
+		TEST_COMPARE(follower.getOffset(), offset);
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::app);
+			file.write(record.data() + 5, static_cast<std::streamsize>(record.size() - 5));
+		}
+		for (std::size_t i = 11; i < particles.size(); ++i)
+			TEST_ASSERT(ObjectSerializer::Serializer::addToFile(filename, &particles[i], settings));
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), particles.size());
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+			TEST_COMPARE(dynamic_cast<Particle*>(loaded[i])->x, static_cast<float>(i));
+		deleteAll(loaded);
+
+		// A file saved again is followed from its beginning
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(filename, { objs[3] }, settings));
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), std::size_t(1));
+		TEST_COMPARE(dynamic_cast<Particle*>(loaded[0])->x, 3.f);
+		deleteAll(loaded);
+
+		// A file replaced by a larger one is followed from its beginning too
+		const std::string replacement = filename + ".new";
+		std::vector<ObjectSerializer::ISerializable*> second(objs.begin() + 5, objs.begin() + 8);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveToFile(replacement, second, settings));
+		std::filesystem::rename(replacement, filename);
+		TEST_ASSERT(follower.waitForChange(std::chrono::milliseconds(1000), std::chrono::milliseconds(5)));
+		TEST_ASSERT(follower.poll(loaded));
+		TEST_COMPARE(loaded.size(), second.size());
+		for (std::size_t i = 0; i < loaded.size(); ++i)
+			TEST_COMPARE(dynamic_cast<Particle*>(loaded[i])->x, static_cast<float>(i + 5));
+		deleteAll(loaded);
+	}
+	TEST_FUNCTION(concurrentWriter)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		const std::string filename = "TST_Serializer_concurrentWriter.bin";
+		std::filesystem::remove(filename);
+		ObjectSerializer::Serializer::Settings settings;
+
+		ObjectSerializer::ConcurrentWriter writer(filename, settings);
+		TEST_ASSERT(!writer.addObject(nullptr));
+		TEST_ASSERT(writer.open());
+		Particle particle;
+		particle.x = -1;
+		TEST_ASSERT(writer.addObject(&particle));
+		TEST_ASSERT(writer.flush());
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), std::size_t(1));
+		deleteAll(loaded);
+
+		// Each thread adds its objects in order, tag holds the thread
+		const std::size_t threadCount = 8;
+		const std::size_t objectCount = 2000;
+		std::vector<std::thread> threads;
+		for (std::size_t t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&writer, t]()
+				{
+					Particle obj;
+					obj.tag[0] = static_cast<char>('a' + t);
+					for (std::size_t i = 0; i < objectCount; ++i)
+					{
+						obj.x = static_cast<float>(i);
+						writer.addObject(&obj);
+					}
+				});
+		}
+		// Records added through the Serializer meanwhile don't overlap the batches
+		const std::size_t addedCount = 200;
+		threads.emplace_back([&filename, &settings]()
+			{
+				for (std::size_t i = 0; i < addedCount; ++i)
+				{
+					Particle obj;
+					obj.tag[0] = 'z';
+					ObjectSerializer::Serializer::addToFile(filename, &obj, settings);
+				}
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+		std::vector<char> record;
+		ObjectSerializer::BufferSink sink(record);
+		TEST_ASSERT(ObjectSerializer::Serializer::saveTo(sink, { &particle }, settings));
+		TEST_ASSERT(writer.addRecord(std::move(record)));
+		TEST_ASSERT(writer.close());
+		TEST_ASSERT(!writer.addObject(&particle));
+
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), threadCount * objectCount + addedCount + 2);
+		std::vector<float> next(threadCount, 0.f);
+		for (std::size_t i = 1; i + 1 < loaded.size(); ++i)
+		{
+			const Particle* obj = dynamic_cast<const Particle*>(loaded[i]);
+			if (obj->tag[0] == 'z')
+				continue;
+			const std::size_t t = static_cast<std::size_t>(obj->tag[0] - 'a');
+			TEST_ASSERT(t < threadCount);
+			TEST_COMPARE(obj->x, next[t]);
+			next[t] += 1.f;
+		}
+		TEST_COMPARE(dynamic_cast<const Particle*>(loaded.back())->x, -1.f);
+		deleteAll(loaded);
+
+		// Every object added while close() runs is either written or rejected
+		std::filesystem::remove(filename);
+		TEST_ASSERT(writer.open());
+		std::atomic<std::size_t> added = 0;
+		threads.clear();
+		for (std::size_t t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&writer, &added]()
+				{
+					Particle obj;
+					while (writer.addObject(&obj))
+						added.fetch_add(1, std::memory_order_relaxed);
+				});
+		}
+		while (added.load(std::memory_order_relaxed) < objectCount)
+			std::this_thread::yield();
+		TEST_ASSERT(writer.close());
+		for (std::thread& thread : threads)
+			thread.join();
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), added.load());
+		deleteAll(loaded);
+	}
+	TEST_FUNCTION(checkpoint)
+	{
+		TEST_START;
+		using namespace TST_SerializerTypes;
+		registerTypes();
+		const std::string filename = "TST_Serializer_checkpoint.bin";
+
+		// Large enough to be staged on several threads
+		std::vector<Particle> particles(100000);
+		Config config;
+		std::vector<ObjectSerializer::ISerializable*> objs = { &config };
+		for (std::size_t i = 0; i < particles.size(); ++i)
+		{
+			particles[i].x = static_cast<float>(i);
+			objs.push_back(&particles[i]);
+		}
+		ObjectSerializer::Serializer::Settings settings;
+		settings.atomicSave = true;
+		std::future<bool> written = ObjectSerializer::Serializer::checkpointToFile(filename, objs, settings);
+		// Changes after the call are not part of the checkpoint
+		for (Particle& particle : particles)
+			particle.x = -1;
+		config.a = 5;
+		TEST_ASSERT(written.get());
+		TEST_ASSERT(!hasTempFile(filename));
+
+		std::vector<ObjectSerializer::ISerializable*> loaded;
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size());
+		TEST_COMPARE(dynamic_cast<Config*>(loaded[0])->a, 1);
+		for (std::size_t i = 0; i < particles.size(); ++i)
+			TEST_COMPARE(dynamic_cast<Particle*>(loaded[i + 1])->x, static_cast<float>(i));
+		deleteAll(loaded);
+
+		// The instance checkpoints its own objects
+		ObjectSerializer::Serializer serializer;
+		serializer.addObject(&config);
+		TEST_ASSERT(serializer.checkpointToFile(filename).get());
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), std::size_t(1));
+		TEST_COMPARE(dynamic_cast<Config*>(loaded[0])->a, 5);
+		deleteAll(loaded);
+
+		// Overlapping checkpoints of one file each write their own temporary file
+		std::vector<std::future<bool>> checkpoints;
+		for (std::size_t i = 0; i < 4; ++i)
+			checkpoints.push_back(ObjectSerializer::Serializer::checkpointToFile(filename, objs, settings));
+		for (std::future<bool>& checkpoint : checkpoints)
+			TEST_ASSERT(checkpoint.get());
+		TEST_ASSERT(!hasTempFile(filename));
+		TEST_ASSERT(ObjectSerializer::Serializer::loadFromFile(filename, loaded, settings));
+		TEST_COMPARE(loaded.size(), objs.size());
+		deleteAll(loaded);
+	}
+};
+
+TEST_INSTANTIATE(TST_Serializer);